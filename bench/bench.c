@@ -0,0 +1,687 @@
+#include <pthread.h>
+#include <sodium.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <flat-tree/flat-tree.h>
+#include <merkle/merkle.h>
+
+#include "hypercore/crypto/crypto.h"
+
+#include "counters.h"
+
+#define MAX_ROOTS 64
+#define MAX_SIZE (4 * 1024 * 1024)
+
+// proofs are for two blocks in the middle of a tree of 1024 blocks, which
+// need one sibling on each of the 9 levels above the pair of leaves
+#define PROOF_BLOCKS 1024
+#define PROOF_NODES 9
+
+/**
+ * Per thread buffers. Every output buffer is preallocated so a run
+ * measures the operation and not `hypercore_crypto_alloc()`.
+ */
+typedef struct context {
+  unsigned char public_key[32];
+  unsigned char secret_key[64];
+  unsigned char signature[64];
+  unsigned char hash[32];
+  unsigned char hashes[MAX_ROOTS][32];
+  unsigned char *message;
+  hypercore_crypto_keypair_t keypair;
+  hypercore_crypto_buffer_t buffers[MAX_ROOTS];
+  hypercore_crypto_node_t nodes[MAX_ROOTS];
+  const hypercore_crypto_node_t *roots[MAX_ROOTS];
+  merkle_t merkle;
+  merkle_t lazy;
+  // every node of a `PROOF_BLOCKS` tree by flat tree index
+  unsigned char (*proof_hashes)[32];
+  unsigned char proof_block[1024];
+  unsigned char proof_tree[32];
+  unsigned char proof_signature[64];
+  unsigned long long proof_range[2];
+  hypercore_crypto_buffer_t proof_blocks[2];
+  hypercore_crypto_buffer_t proof_buffers[PROOF_NODES + 1];
+  hypercore_crypto_node_t proof_nodes[PROOF_NODES + 1];
+  const hypercore_crypto_node_t *proof_list[PROOF_NODES];
+  const hypercore_crypto_node_t *proof_root;
+  unsigned long long sink;
+} context_t;
+
+/**
+ * `size` parameterizes the run, `bytes` is the input consumed and
+ * `nodes` the tree nodes touched per operation.
+ */
+typedef struct bench {
+  const char *name;
+  unsigned long int size;
+  unsigned long int bytes;
+  unsigned long int nodes;
+  int (*run)(context_t *ctx, unsigned long int size, unsigned long long iterations);
+} bench_t;
+
+typedef struct worker {
+  context_t ctx;
+  const bench_t *bench;
+  counters_t counters;
+  unsigned long long iterations;
+  pthread_t thread;
+  int rc;
+} worker_t;
+
+// read hardware counters around each run with `--counters`
+static int counting = 0;
+
+static unsigned long long
+now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+bench_keypair(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (0 != hypercore_crypto_keypair(&ctx->keypair, 0)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_sign(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t signature = { sizeof(ctx->signature), ctx->signature };
+  hypercore_crypto_buffer_t message = { size, ctx->message };
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (0 != hypercore_crypto_sign(&signature, &message, &ctx->keypair.secret_key)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_verify(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t signature = { sizeof(ctx->signature), ctx->signature };
+  hypercore_crypto_buffer_t message = { size, ctx->message };
+
+  if (0 != hypercore_crypto_sign(&signature, &message, &ctx->keypair.secret_key)) {
+    return -1;
+  }
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (0 != hypercore_crypto_verify(&signature, &message, &ctx->keypair.public_key)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_data(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t hash = { sizeof(ctx->hash), ctx->hash };
+  hypercore_crypto_buffer_t message = { size, ctx->message };
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (0 != hypercore_crypto_data(&hash, &message)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_parent(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t hash = { sizeof(ctx->hash), ctx->hash };
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (0 != hypercore_crypto_parent(&hash, &ctx->nodes[0], &ctx->nodes[1])) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_tree(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t hash = { sizeof(ctx->hash), ctx->hash };
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (0 != hypercore_crypto_tree(&hash, ctx->roots, size)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_discoverykey(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t hash = { sizeof(ctx->hash), ctx->hash };
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (hypercore_crypto_discoverykey(&hash, &ctx->keypair.public_key) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_randombytes(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t out = { size, ctx->message };
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    if (hypercore_crypto_randombytes(&out) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_merkle_next(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    merkle_node_list_t *nodes = merkle_next(&ctx->merkle, ctx->message, size, 0);
+
+    if (0 == nodes) {
+      return -1;
+    }
+
+    merkle_node_list_destroy(nodes);
+  }
+
+  return 0;
+}
+
+static int
+bench_merkle_lazy(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    merkle_node_list_t *nodes = merkle_next(&ctx->lazy, ctx->message, size, 0);
+
+    // parents of a burst of appends are hashed in one flush
+    if (0 != nodes && (1023 == (i & 1023) || i + 1 == iterations)) {
+      nodes = merkle_flush(&ctx->lazy, nodes);
+    }
+
+    if (0 == nodes) {
+      return -1;
+    }
+
+    merkle_node_list_destroy(nodes);
+  }
+
+  return 0;
+}
+
+static int
+bench_proof_nodes(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  unsigned long long indices[PROOF_NODES];
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    unsigned long long count = PROOF_NODES;
+
+    if (0 != hypercore_crypto_proof_nodes(PROOF_BLOCKS, ctx->proof_range, 1, indices, &count)) {
+      return -1;
+    }
+
+    ctx->sink += count;
+  }
+
+  return 0;
+}
+
+static int
+bench_proof_verify(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  hypercore_crypto_buffer_t signature = { sizeof(ctx->proof_signature), ctx->proof_signature };
+  hypercore_crypto_buffer_t tree = { sizeof(ctx->proof_tree), ctx->proof_tree };
+
+  // `keypair` may have replaced the key since the context was set up
+  if (0 != hypercore_crypto_sign(&signature, &tree, &ctx->keypair.secret_key)) {
+    return -1;
+  }
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    int rc = hypercore_crypto_proof_verify(
+      ctx->proof_range, 1,
+      ctx->proof_blocks,
+      ctx->proof_list, PROOF_NODES,
+      &ctx->proof_root, 1,
+      &signature,
+      &ctx->keypair.public_key);
+
+    if (0 != rc) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+bench_flat_tree(context_t *ctx, unsigned long int size, unsigned long long iterations) {
+  unsigned long long sink = 0;
+  ft_ulong range[2];
+
+  for (unsigned long long i = 0; i < iterations; ++i) {
+    ft_ulong index = i & 0xffff;
+    ft_spans(range, index, 0);
+    sink += ft_parent(index, 0) + ft_sibling(index, 0) + range[0] + range[1];
+  }
+
+  ctx->sink += sink;
+  return 0;
+}
+
+static const unsigned long int data_sizes[] = {
+  16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576, MAX_SIZE
+};
+
+static const unsigned long int tree_sizes[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+static bench_t benches[64] = {
+  { "keypair", 0, 0, 0, bench_keypair },
+  { "sign", 64, 64, 0, bench_sign },
+  { "verify", 64, 64, 0, bench_verify },
+  { "parent", 2, 64, 2, bench_parent },
+  { "discoverykey", 32, 32, 0, bench_discoverykey },
+  { "randombytes", 32, 32, 0, bench_randombytes },
+  // a leaf and on average one parent per block
+  { "merkle_next", 1024, 1024, 2, bench_merkle_next },
+  { "merkle_lazy", 1024, 1024, 2, bench_merkle_lazy },
+  // the walk visits the root and both children on each of 9 levels
+  { "proof_nodes", 2, 0, 19, bench_proof_nodes },
+  // 2 leaves and 10 parents are hashed and 9 sibling nodes read
+  { "proof_verify", 2, 2048, 21, bench_proof_verify },
+  { "flat_tree", 0, 0, 0, bench_flat_tree },
+};
+
+static unsigned long int length = 11;
+
+/**
+ * Hashes every node of a `PROOF_BLOCKS` tree of 1024 byte blocks and
+ * selects the nodes proving two blocks in its middle.
+ */
+static int
+proof_init(context_t *ctx) {
+  unsigned long long indices[PROOF_NODES + 1];
+  unsigned long long count = PROOF_NODES;
+  hypercore_crypto_buffer_t block = { sizeof(ctx->proof_block), ctx->proof_block };
+  hypercore_crypto_buffer_t tree = { sizeof(ctx->proof_tree), ctx->proof_tree };
+
+  // kept apart from `message`, which `randombytes` overwrites
+  memset(ctx->proof_block, 0x68, sizeof(ctx->proof_block));
+  ctx->proof_hashes = malloc((2 * PROOF_BLOCKS - 1) * sizeof(*ctx->proof_hashes));
+
+  if (0 == ctx->proof_hashes) {
+    return -1;
+  }
+
+  for (ft_ulong depth = 0; (1UL << depth) <= PROOF_BLOCKS; ++depth) {
+    for (ft_ulong offset = 0; offset < PROOF_BLOCKS >> depth; ++offset) {
+      ft_ulong index = ft_index(depth, offset);
+      hypercore_crypto_buffer_t hash = { 32, ctx->proof_hashes[index] };
+      ft_ulong children[2];
+
+      if (0 == depth) {
+        if (0 != hypercore_crypto_data(&hash, &block)) {
+          return -1;
+        }
+
+        continue;
+      }
+
+      ft_children(children, index, depth);
+
+      hypercore_crypto_buffer_t hashes[2] = {
+        { 32, ctx->proof_hashes[children[0]] },
+        { 32, ctx->proof_hashes[children[1]] }
+      };
+
+      hypercore_crypto_node_t left = { children[0], 1024UL << (depth - 1), &hashes[0] };
+      hypercore_crypto_node_t right = { children[1], 1024UL << (depth - 1), &hashes[1] };
+
+      if (0 != hypercore_crypto_parent(&hash, &left, &right)) {
+        return -1;
+      }
+    }
+  }
+
+  ctx->proof_range[0] = PROOF_BLOCKS / 2;
+  ctx->proof_range[1] = PROOF_BLOCKS / 2 + 2;
+  ctx->proof_blocks[0] = block;
+  ctx->proof_blocks[1] = block;
+
+  if (
+    0 != hypercore_crypto_proof_nodes(PROOF_BLOCKS, ctx->proof_range, 1, indices, &count) ||
+    PROOF_NODES != count
+  ) {
+    return -1;
+  }
+
+  // the single root is last
+  indices[count] = PROOF_BLOCKS - 1;
+
+  for (unsigned long long i = 0; i <= count; ++i) {
+    ctx->proof_buffers[i] = (hypercore_crypto_buffer_t) { 32, ctx->proof_hashes[indices[i]] };
+    ctx->proof_nodes[i] = (hypercore_crypto_node_t) {
+      .index = indices[i],
+      .size = 1024UL << ft_depth(indices[i]),
+      .hash = &ctx->proof_buffers[i]
+    };
+  }
+
+  for (unsigned long long i = 0; i < count; ++i) {
+    ctx->proof_list[i] = &ctx->proof_nodes[i];
+  }
+
+  ctx->proof_root = &ctx->proof_nodes[count];
+
+  return hypercore_crypto_tree(&tree, &ctx->proof_root, 1);
+}
+
+static int
+context_init(context_t *ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+
+  ctx->message = malloc(MAX_SIZE);
+
+  if (0 == ctx->message) {
+    return -1;
+  }
+
+  memset(ctx->message, 0x68, MAX_SIZE);
+
+  ctx->keypair.public_key = (hypercore_crypto_buffer_t) { 32, ctx->public_key };
+  ctx->keypair.secret_key = (hypercore_crypto_buffer_t) { 64, ctx->secret_key };
+
+  if (0 != hypercore_crypto_keypair(&ctx->keypair, 0)) {
+    return -1;
+  }
+
+  for (int i = 0; i < MAX_ROOTS; ++i) {
+    memset(ctx->hashes[i], i, 32);
+    ctx->buffers[i] = (hypercore_crypto_buffer_t) { 32, ctx->hashes[i] };
+    ctx->nodes[i] = (hypercore_crypto_node_t) {
+      .index = 2 * i,
+      .size = 1024,
+      .hash = &ctx->buffers[i]
+    };
+    ctx->roots[i] = &ctx->nodes[i];
+  }
+
+  if (0 != proof_init(ctx)) {
+    return -1;
+  }
+
+  if (0 != merkle_init(&ctx->lazy, (merkle_options_t) { .lazy = 1 })) {
+    return -1;
+  }
+
+  return merkle_init(&ctx->merkle, MERKLE_DEFAULT_OPTIONS);
+}
+
+static void
+context_destroy(context_t *ctx) {
+  merkle_destroy(&ctx->merkle);
+  merkle_destroy(&ctx->lazy);
+  free(ctx->proof_hashes);
+  free(ctx->message);
+}
+
+static void *
+work(void *arg) {
+  worker_t *worker = arg;
+  const bench_t *bench = worker->bench;
+
+  // counters are opened on the thread they measure
+  if (counting) {
+    counters_init(&worker->counters);
+    counters_start(&worker->counters);
+  }
+
+  worker->rc = bench->run(&worker->ctx, bench->size, worker->iterations);
+
+  if (counting) {
+    counters_stop(&worker->counters);
+    counters_destroy(&worker->counters);
+  }
+
+  return 0;
+}
+
+/**
+ * Runs `iterations` of `bench` on each of `threads` threads and returns
+ * the wall clock time in nanoseconds, or `0` on failure.
+ */
+static unsigned long long
+measure(
+  const bench_t *bench,
+  worker_t *workers,
+  unsigned long int threads,
+  unsigned long long iterations
+) {
+  unsigned long long start = now();
+  int failed = 0;
+
+  for (unsigned long int i = 0; i < threads; ++i) {
+    workers[i].bench = bench;
+    workers[i].iterations = iterations;
+    workers[i].rc = 0;
+  }
+
+  if (1 == threads) {
+    work(&workers[0]);
+  } else {
+    for (unsigned long int i = 0; i < threads; ++i) {
+      pthread_create(&workers[i].thread, 0, work, &workers[i]);
+    }
+
+    for (unsigned long int i = 0; i < threads; ++i) {
+      pthread_join(workers[i].thread, 0);
+    }
+  }
+
+  for (unsigned long int i = 0; i < threads; ++i) {
+    failed |= workers[i].rc;
+  }
+
+  return 0 == failed ? now() - start : 0;
+}
+
+/**
+ * Prints the counters summed over `threads` workers as per operation,
+ * per byte and per node ratios.
+ */
+static void
+print_counters(
+  const bench_t *bench,
+  const worker_t *workers,
+  unsigned long int threads,
+  unsigned long long ops
+) {
+  static const char *names[COUNTER_MAX] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"
+  };
+
+  unsigned long long values[COUNTER_MAX] = { 0 };
+  int source = workers[0].counters.source;
+
+  for (unsigned long int i = 0; i < threads; ++i) {
+    for (int j = 0; j < COUNTER_MAX; ++j) {
+      values[j] += workers[i].counters.values[j];
+    }
+  }
+
+  printf(", \"counters\": \"%s\"", counters_sources[source]);
+
+  for (int j = 0; j < COUNTER_MAX; ++j) {
+    // the time stamp counter only stands in for cycles
+    if (COUNTERS_PERF == source || (COUNTERS_TSC == source && COUNTER_CYCLES == j)) {
+      printf(", \"%s_per_op\": %.2f", names[j], (double) values[j] / ops);
+    }
+  }
+
+  if (COUNTERS_NONE != source && bench->bytes > 0) {
+    printf(", \"cycles_per_byte\": %.3f",
+      (double) values[COUNTER_CYCLES] / ops / bench->bytes);
+  }
+
+  if (COUNTERS_PERF == source && bench->nodes > 0) {
+    printf(", \"cache_misses_per_node\": %.3f",
+      (double) values[COUNTER_CACHE_MISSES] / ops / bench->nodes);
+  }
+}
+
+static void
+usage(const char *name) {
+  fprintf(stderr,
+    "usage: %s [--threads=N] [--time=MS] [--filter=NAME] [--counters]\n", name);
+}
+
+int
+main(int argc, char **argv) {
+  unsigned long int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned long long budget = 200;
+  const char *filter = 0;
+  worker_t *workers = 0;
+  int first = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    if (0 == strncmp(argv[i], "--threads=", 10)) {
+      threads = strtoul(argv[i] + 10, 0, 10);
+    } else if (0 == strncmp(argv[i], "--time=", 7)) {
+      budget = strtoull(argv[i] + 7, 0, 10);
+    } else if (0 == strncmp(argv[i], "--filter=", 9)) {
+      filter = argv[i] + 9;
+    } else if (0 == strcmp(argv[i], "--counters")) {
+      counting = 1;
+    } else if (0 == strcmp(argv[i], "--help")) {
+      usage(argv[0]);
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (0 == threads) {
+    threads = 1;
+  }
+
+  for (unsigned long int i = 0; i < sizeof(data_sizes) / sizeof(*data_sizes); ++i) {
+    benches[length++] = (bench_t) {
+      "data", data_sizes[i], data_sizes[i], 1, bench_data
+    };
+  }
+
+  for (unsigned long int i = 0; i < sizeof(tree_sizes) / sizeof(*tree_sizes); ++i) {
+    benches[length++] = (bench_t) {
+      // a 32 byte hash, an index and a length per root
+      "tree", tree_sizes[i], tree_sizes[i] * 48, tree_sizes[i], bench_tree
+    };
+  }
+
+  workers = calloc(threads, sizeof(*workers));
+
+  if (0 == workers) {
+    return 1;
+  }
+
+  for (unsigned long int i = 0; i < threads; ++i) {
+    if (0 != context_init(&workers[i].ctx)) {
+      fprintf(stderr, "error: failed to initialize context\n");
+      return 1;
+    }
+  }
+
+  printf("{\n");
+  printf("  \"version\": \"%s\",\n", hypercore_crypto_version_string());
+  printf("  \"sodium\": \"%s\",\n", sodium_version_string());
+  printf("  \"threads\": %lu,\n", threads);
+  printf("  \"time_ms\": %llu,\n", budget);
+  printf("  \"results\": [");
+
+  for (unsigned long int i = 0; i < length; ++i) {
+    const bench_t *bench = &benches[i];
+    unsigned long long iterations = 1;
+    unsigned long long elapsed = 0;
+
+    if (0 != filter && 0 != strcmp(filter, bench->name)) {
+      continue;
+    }
+
+    // grow the iteration count on one thread until a run fills the budget
+    while (1) {
+      elapsed = measure(bench, workers, 1, iterations);
+
+      if (0 == elapsed || elapsed >= budget * 1000000ULL || iterations >= (1ULL << 40)) {
+        break;
+      }
+
+      iterations *= elapsed < budget * 100000ULL ? 10 : 2;
+    }
+
+    if (0 == elapsed) {
+      fprintf(stderr, "error: %s failed\n", bench->name);
+      return 1;
+    }
+
+    // one single threaded run, then the same work on every thread
+    for (int run = 0; run < (threads > 1 ? 2 : 1); ++run) {
+      unsigned long int n = 0 == run ? 1 : threads;
+      unsigned long long ops = iterations * n;
+      double seconds = 0;
+
+      if (n > 1) {
+        elapsed = measure(bench, workers, n, iterations);
+      }
+
+      if (0 == elapsed) {
+        fprintf(stderr, "error: %s failed\n", bench->name);
+        return 1;
+      }
+
+      seconds = elapsed / 1e9;
+
+      printf("%s\n    {", first ? "" : ",");
+      printf(" \"name\": \"%s\",", bench->name);
+      printf(" \"size\": %lu,", bench->size);
+      printf(" \"threads\": %lu,", n);
+      printf(" \"iterations\": %llu,", ops);
+      // time per operation as seen by one thread
+      printf(" \"ns_per_op\": %.2f,", (double) elapsed / iterations);
+      printf(" \"ops_per_sec\": %.2f,", ops / seconds);
+      printf(" \"bytes_per_sec\": %.2f", (double) ops * bench->bytes / seconds);
+
+      if (counting) {
+        print_counters(bench, workers, n, ops);
+      }
+
+      printf(" }");
+      first = 0;
+    }
+  }
+
+  printf("\n  ]\n}\n");
+
+  for (unsigned long int i = 0; i < threads; ++i) {
+    context_destroy(&workers[i].ctx);
+  }
+
+  free(workers);
+  return 0;
+}
@@ -0,0 +1,175 @@
+#ifndef HYPERCORE_CRYPTO_BENCH_COUNTERS_H
+#define HYPERCORE_CRYPTO_BENCH_COUNTERS_H
+
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Hardware counters of the calling thread around a measured loop. Uses a
+ * `perf_event_open()` group where the kernel allows it and falls back to
+ * the time stamp counter, which only provides `cycles`.
+ */
+enum {
+  COUNTERS_NONE = 0,
+  COUNTERS_PERF,
+  COUNTERS_TSC
+};
+
+enum {
+  COUNTER_CYCLES = 0,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_CACHE_MISSES,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_MAX
+};
+
+typedef struct counters {
+  int source;
+  int fds[COUNTER_MAX];
+  unsigned long long start;
+  unsigned long long values[COUNTER_MAX];
+} counters_t;
+
+static const char *counters_sources[] = { "none", "perf", "tsc" };
+
+static inline unsigned long long
+counters_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int lo = 0;
+  unsigned int hi = 0;
+  __asm__ __volatile__ ("lfence; rdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+  return (unsigned long long) hi << 32 | lo;
+#elif defined(__aarch64__)
+  unsigned long long value = 0;
+  __asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (value) :: "memory");
+  return value;
+#else
+  return 0;
+#endif
+}
+
+static inline int
+counters_has_tsc() {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+#if defined(__linux__)
+static int
+counters_open(unsigned long long config, int group) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = -1 == group;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+/**
+ * Opens the counters for the calling thread.
+ */
+static int
+counters_init(counters_t *counters) {
+  memset(counters, 0, sizeof(*counters));
+
+  for (int i = 0; i < COUNTER_MAX; ++i) {
+    counters->fds[i] = -1;
+  }
+
+#if defined(__linux__)
+  static const unsigned long long configs[COUNTER_MAX] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+
+  counters->fds[0] = counters_open(configs[0], -1);
+
+  for (int i = 1; counters->fds[0] >= 0 && i < COUNTER_MAX; ++i) {
+    counters->fds[i] = counters_open(configs[i], counters->fds[0]);
+
+    if (counters->fds[i] < 0) {
+      for (int j = 0; j < i; ++j) {
+        close(counters->fds[j]);
+        counters->fds[j] = -1;
+      }
+    }
+  }
+
+  if (counters->fds[0] >= 0) {
+    counters->source = COUNTERS_PERF;
+    return counters->source;
+  }
+#endif
+
+  counters->source = counters_has_tsc() ? COUNTERS_TSC : COUNTERS_NONE;
+  return counters->source;
+}
+
+static void
+counters_destroy(counters_t *counters) {
+  for (int i = 0; i < COUNTER_MAX; ++i) {
+    if (counters->fds[i] >= 0) {
+      close(counters->fds[i]);
+      counters->fds[i] = -1;
+    }
+  }
+}
+
+static void
+counters_start(counters_t *counters) {
+  memset(counters->values, 0, sizeof(counters->values));
+
+#if defined(__linux__)
+  if (COUNTERS_PERF == counters->source) {
+    ioctl(counters->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return;
+  }
+#endif
+
+  counters->start = counters_tsc();
+}
+
+static void
+counters_stop(counters_t *counters) {
+#if defined(__linux__)
+  if (COUNTERS_PERF == counters->source) {
+    // `PERF_FORMAT_GROUP` reads the number of events, then each value
+    unsigned long long group[1 + COUNTER_MAX] = { 0 };
+
+    ioctl(counters->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    if (read(counters->fds[0], group, sizeof(group)) > 0) {
+      for (unsigned long long i = 0; i < group[0] && i < COUNTER_MAX; ++i) {
+        counters->values[i] = group[1 + i];
+      }
+    }
+
+    return;
+  }
+#endif
+
+  if (COUNTERS_TSC == counters->source) {
+    counters->values[COUNTER_CYCLES] = counters_tsc() - counters->start;
+  }
+}
+
+#endif
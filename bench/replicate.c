@@ -0,0 +1,687 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <flat-tree/flat-tree.h>
+#include <merkle/merkle.h>
+
+#include "hypercore/crypto/crypto.h"
+
+#define MAX_NODES 64
+#define HASH_BYTES 32
+#define SIGNATURE_BYTES 64
+
+/**
+ * A replication workload. Writers append blocks to `feeds` feeds with
+ * `merkle_next()` and sign the tree hash after every append. A replica
+ * then receives every block from `peers` simulated peers in `order` and
+ * verifies each one against the nodes it already trusts, the proof sent
+ * with the block and, when it reaches an unverified root, the signature
+ * of the tree the sending peer has.
+ */
+enum {
+  ORDER_SEQUENTIAL = 0,
+  ORDER_REVERSE,
+  ORDER_RANDOM,
+  ORDER_STRIDED,
+  ORDER_MAX
+};
+
+static const char *orders[ORDER_MAX] = {
+  "sequential", "reverse", "random", "strided"
+};
+
+/**
+ * A feed as written, indexed by flat tree index, and the replica's
+ * view of it which only holds nodes it has verified.
+ */
+typedef struct feed {
+  unsigned char public_key[32];
+  unsigned char secret_key[64];
+  hypercore_crypto_keypair_t keypair;
+  unsigned char *data;
+  unsigned long int *sizes;
+  unsigned char (*hashes)[HASH_BYTES];
+  // signature of the tree hash at each length
+  unsigned char (*signatures)[SIGNATURE_BYTES];
+  unsigned long int *order;
+  unsigned long int *replica_sizes;
+  unsigned char (*replica_hashes)[HASH_BYTES];
+  unsigned char *trusted;
+} feed_t;
+
+typedef struct proof_node {
+  unsigned long int index;
+  unsigned long int size;
+  unsigned char hash[HASH_BYTES];
+} proof_node_t;
+
+/**
+ * A block as sent by a peer with the tree at `length` blocks: the
+ * uncle nodes from the block up to its root, every root and the
+ * signature of the tree hash.
+ */
+typedef struct message {
+  feed_t *feed;
+  unsigned long int block;
+  unsigned long int length;
+  unsigned char *data;
+  unsigned long int size;
+  unsigned long int nodes_length;
+  proof_node_t nodes[MAX_NODES];
+  unsigned long int roots_length;
+  proof_node_t roots[MAX_NODES];
+  unsigned char *signature;
+} message_t;
+
+typedef struct options {
+  unsigned long int feeds;
+  unsigned long int blocks;
+  unsigned long int min_size;
+  unsigned long int max_size;
+  unsigned long int peers;
+  unsigned long int order;
+  unsigned long long seed;
+} options_t;
+
+typedef struct stats {
+  unsigned long long count;
+  unsigned long long bytes;
+  unsigned long long proof_bytes;
+  unsigned long long signatures;
+  unsigned long long *latencies;
+} stats_t;
+
+static unsigned long long state = 0;
+
+static unsigned long long
+now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// xorshift64*, seeded so a workload can be replayed
+static unsigned long long
+next_random() {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dULL;
+}
+
+static unsigned long int
+block_size(const options_t *options) {
+  unsigned long int range = options->max_size - options->min_size + 1;
+  return options->min_size + (1 == range ? 0 : next_random() % range);
+}
+
+/**
+ * Hypercore leaf and parent hashes for `merkle_next()` in place of its
+ * default SHA-256 codec.
+ */
+static unsigned long int
+leaf_hash(unsigned char **hash, merkle_node_t *node, merkle_node_list_t *roots) {
+  hypercore_crypto_buffer_t data = { node->size, node->data };
+  hypercore_crypto_buffer_t out = { HASH_BYTES, merkle_alloc(HASH_BYTES) };
+  hypercore_crypto_node_t leaf = {
+    .index = node->index,
+    .size = node->size,
+    .data = &data
+  };
+
+  hypercore_crypto_leaf(&out, &leaf);
+  *hash = out.bytes;
+  return HASH_BYTES;
+}
+
+static unsigned long int
+parent_hash(unsigned char **hash, merkle_node_t *left, merkle_node_t *right) {
+  hypercore_crypto_buffer_t out = { HASH_BYTES, merkle_alloc(HASH_BYTES) };
+  hypercore_crypto_buffer_t hashes[2] = {
+    { left->hash_size, left->hash },
+    { right->hash_size, right->hash }
+  };
+
+  hypercore_crypto_parent(&out,
+    &(hypercore_crypto_node_t) { left->index, left->size, &hashes[0], 0 },
+    &(hypercore_crypto_node_t) { right->index, right->size, &hashes[1], 0 });
+
+  *hash = out.bytes;
+  return HASH_BYTES;
+}
+
+/**
+ * Returns `1` if `index` is a root of the tree at `length` blocks.
+ */
+static int
+is_root(unsigned long int index, unsigned long int length) {
+  return
+    ft_right_span(index, 0) / 2 < length &&
+    ft_right_span(ft_parent(index, 0), 0) / 2 >= length;
+}
+
+/**
+ * Writes the indices of the roots of the tree at `length` blocks into
+ * `roots` and returns their count.
+ */
+static unsigned long int
+roots_of(unsigned long int *roots, unsigned long int length) {
+  unsigned long int count = 0;
+  unsigned long int offset = 0;
+
+  while (length > 0) {
+    unsigned long int width = 1UL << (63 - __builtin_clzll(length));
+    roots[count++] = 2 * offset + width - 1;
+    offset += width;
+    length -= width;
+  }
+
+  return count;
+}
+
+static int
+tree_hash(
+  unsigned char *hash,
+  const proof_node_t *nodes,
+  unsigned long int length
+) {
+  hypercore_crypto_buffer_t out = { HASH_BYTES, hash };
+  hypercore_crypto_buffer_t hashes[MAX_NODES];
+  hypercore_crypto_node_t roots[MAX_NODES];
+  const hypercore_crypto_node_t *pointers[MAX_NODES];
+
+  for (unsigned long int i = 0; i < length; ++i) {
+    hashes[i] = (hypercore_crypto_buffer_t) { HASH_BYTES, (unsigned char *) nodes[i].hash };
+    roots[i] = (hypercore_crypto_node_t) { nodes[i].index, nodes[i].size, &hashes[i], 0 };
+    pointers[i] = &roots[i];
+  }
+
+  return hypercore_crypto_tree(&out, pointers, length);
+}
+
+static void
+feed_destroy(feed_t *feed) {
+  free(feed->data);
+  free(feed->sizes);
+  free(feed->hashes);
+  free(feed->signatures);
+  free(feed->order);
+  free(feed->replica_sizes);
+  free(feed->replica_hashes);
+  free(feed->trusted);
+}
+
+static int
+feed_init(feed_t *feed, const options_t *options) {
+  unsigned long int nodes = 2 * options->blocks;
+
+  memset(feed, 0, sizeof(*feed));
+
+  feed->data = malloc(options->blocks * options->max_size);
+  feed->sizes = calloc(nodes, sizeof(*feed->sizes));
+  feed->hashes = calloc(nodes, sizeof(*feed->hashes));
+  feed->signatures = calloc(options->blocks, sizeof(*feed->signatures));
+  feed->order = calloc(options->blocks, sizeof(*feed->order));
+  feed->replica_sizes = calloc(nodes, sizeof(*feed->replica_sizes));
+  feed->replica_hashes = calloc(nodes, sizeof(*feed->replica_hashes));
+  feed->trusted = calloc(nodes, sizeof(*feed->trusted));
+
+  if (
+    0 == feed->data ||
+    0 == feed->sizes ||
+    0 == feed->hashes ||
+    0 == feed->signatures ||
+    0 == feed->order ||
+    0 == feed->replica_sizes ||
+    0 == feed->replica_hashes ||
+    0 == feed->trusted
+  ) {
+    return -1;
+  }
+
+  feed->keypair.public_key = (hypercore_crypto_buffer_t) { 32, feed->public_key };
+  feed->keypair.secret_key = (hypercore_crypto_buffer_t) { 64, feed->secret_key };
+
+  for (unsigned long int i = 0; i < options->blocks * options->max_size; ++i) {
+    feed->data[i] = next_random();
+  }
+
+  return hypercore_crypto_keypair(&feed->keypair, 0);
+}
+
+/**
+ * Appends every block of `feed` and signs the tree hash after each
+ * append, recording the latency of both.
+ */
+static int
+append(feed_t *feed, const options_t *options, stats_t *stats) {
+  merkle_codec_t codec = { leaf_hash, parent_hash };
+  proof_node_t roots[MAX_NODES];
+  unsigned char hash[HASH_BYTES];
+  merkle_t merkle = { 0 };
+  int rc = 0;
+
+  if (0 != merkle_init(&merkle, (merkle_options_t) { codec })) {
+    return -1;
+  }
+
+  for (unsigned long int i = 0; 0 == rc && i < options->blocks; ++i) {
+    unsigned long long start = now();
+    unsigned long int size = block_size(options);
+    unsigned char *data = feed->data + i * options->max_size;
+    merkle_node_list_t *nodes = merkle_next(&merkle, data, size, 0);
+    hypercore_crypto_buffer_t message = { HASH_BYTES, hash };
+    hypercore_crypto_buffer_t signature = { SIGNATURE_BYTES, feed->signatures[i] };
+
+    if (0 == nodes) {
+      rc = -1;
+      break;
+    }
+
+    for (unsigned long int j = 0; j < nodes->length; ++j) {
+      feed->sizes[nodes->list[j]->index] = nodes->list[j]->size;
+      memcpy(feed->hashes[nodes->list[j]->index], nodes->list[j]->hash, HASH_BYTES);
+    }
+
+    merkle_node_list_destroy(nodes);
+
+    for (unsigned long int j = 0; j < merkle.roots.length; ++j) {
+      roots[j].index = merkle.roots.list[j]->index;
+      roots[j].size = merkle.roots.list[j]->size;
+      memcpy(roots[j].hash, merkle.roots.list[j]->hash, HASH_BYTES);
+    }
+
+    if (
+      0 != tree_hash(hash, roots, merkle.roots.length) ||
+      0 != hypercore_crypto_sign(&signature, &message, &feed->keypair.secret_key)
+    ) {
+      rc = -1;
+    }
+
+    stats->latencies[stats->count++] = now() - start;
+    stats->bytes += size;
+    stats->signatures++;
+  }
+
+  merkle_destroy(&merkle);
+  return rc;
+}
+
+/**
+ * Orders the blocks of `feed` as the replica will receive them.
+ */
+static void
+order(feed_t *feed, const options_t *options) {
+  unsigned long int blocks = options->blocks;
+  unsigned long int stripe = (blocks + options->peers - 1) / options->peers;
+  unsigned long int count = 0;
+
+  for (unsigned long int i = 0; i < blocks; ++i) {
+    feed->order[i] = ORDER_REVERSE == options->order ? blocks - 1 - i : i;
+  }
+
+  if (ORDER_RANDOM == options->order) {
+    for (unsigned long int i = blocks - 1; i > 0; --i) {
+      unsigned long int j = next_random() % (i + 1);
+      unsigned long int swap = feed->order[i];
+      feed->order[i] = feed->order[j];
+      feed->order[j] = swap;
+    }
+  } else if (ORDER_STRIDED == options->order) {
+    // each peer sends a contiguous stripe and the stripes interleave
+    for (unsigned long int i = 0; i < stripe; ++i) {
+      for (unsigned long int p = 0; p < options->peers; ++p) {
+        if (p * stripe + i < blocks) {
+          feed->order[count++] = p * stripe + i;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Length of the tree peer `peer` has. Peers are at different points
+ * between half of the feed and all of it, so blocks near the end are
+ * only available from some of them.
+ */
+static unsigned long int
+peer_length(const options_t *options, unsigned long int peer) {
+  return options->blocks * (options->peers + peer + 1) / (2 * options->peers);
+}
+
+/**
+ * Builds the message peer `peer` sends for `block`.
+ */
+static void
+prepare(
+  message_t *message,
+  feed_t *feed,
+  const options_t *options,
+  unsigned long int peer,
+  unsigned long int block
+) {
+  unsigned long int roots[MAX_NODES];
+  unsigned long int length = peer_length(options, peer);
+  unsigned long int index = 2 * block;
+
+  message->feed = feed;
+  message->block = block;
+  message->length = length;
+  message->data = feed->data + block * options->max_size;
+  message->size = feed->sizes[index];
+  message->signature = feed->signatures[length - 1];
+  message->nodes_length = 0;
+
+  while (!is_root(index, length)) {
+    proof_node_t *node = &message->nodes[message->nodes_length++];
+    node->index = ft_sibling(index, 0);
+    node->size = feed->sizes[node->index];
+    memcpy(node->hash, feed->hashes[node->index], HASH_BYTES);
+    index = ft_parent(index, 0);
+  }
+
+  message->roots_length = roots_of(roots, length);
+
+  for (unsigned long int i = 0; i < message->roots_length; ++i) {
+    proof_node_t *node = &message->roots[i];
+    node->index = roots[i];
+    node->size = feed->sizes[roots[i]];
+    memcpy(node->hash, feed->hashes[roots[i]], HASH_BYTES);
+  }
+}
+
+static void
+trust(feed_t *feed, unsigned long int index, unsigned long int size, const unsigned char *hash) {
+  feed->trusted[index] = 1;
+  feed->replica_sizes[index] = size;
+  memcpy(feed->replica_hashes[index], hash, HASH_BYTES);
+}
+
+/**
+ * Verifies a received block. The path from the block is hashed until it
+ * meets a trusted node, or a root of the sender's tree whose signature
+ * is then verified. Nodes on the path are only trusted once it checks.
+ */
+static int
+verify(message_t *message, stats_t *stats) {
+  feed_t *feed = message->feed;
+  proof_node_t path[2 * MAX_NODES];
+  unsigned long int length = 0;
+  unsigned long int index = 2 * message->block;
+  unsigned long int size = message->size;
+  unsigned char hash[HASH_BYTES];
+  hypercore_crypto_buffer_t out = { HASH_BYTES, hash };
+  hypercore_crypto_buffer_t data = { message->size, message->data };
+  hypercore_crypto_node_t leaf = { .index = index, .size = size, .data = &data };
+
+  if (0 != hypercore_crypto_leaf(&out, &leaf)) {
+    return -1;
+  }
+
+  for (unsigned long int level = 0; ; ++level) {
+    if (feed->trusted[index]) {
+      if (0 != memcmp(feed->replica_hashes[index], hash, HASH_BYTES)) {
+        return -1;
+      }
+
+      break;
+    }
+
+    path[length].index = index;
+    path[length].size = size;
+    memcpy(path[length++].hash, hash, HASH_BYTES);
+
+    if (is_root(index, message->length)) {
+      unsigned char tree[HASH_BYTES];
+      hypercore_crypto_buffer_t signature = { SIGNATURE_BYTES, message->signature };
+      hypercore_crypto_buffer_t signed_hash = { HASH_BYTES, tree };
+      int found = 0;
+
+      for (unsigned long int i = 0; i < message->roots_length; ++i) {
+        if (index == message->roots[i].index) {
+          found = 0 == memcmp(message->roots[i].hash, hash, HASH_BYTES);
+        }
+      }
+
+      if (
+        !found ||
+        0 != tree_hash(tree, message->roots, message->roots_length) ||
+        0 != hypercore_crypto_verify(&signature, &signed_hash, &feed->keypair.public_key)
+      ) {
+        return -1;
+      }
+
+      for (unsigned long int i = 0; i < message->roots_length; ++i) {
+        const proof_node_t *root = &message->roots[i];
+        trust(feed, root->index, root->size, root->hash);
+      }
+
+      stats->signatures++;
+      break;
+    }
+
+    unsigned long int sibling = ft_sibling(index, 0);
+    hypercore_crypto_buffer_t hashes[2];
+    hypercore_crypto_node_t nodes[2];
+    proof_node_t *uncle = &path[length++];
+
+    if (feed->trusted[sibling]) {
+      uncle->index = sibling;
+      uncle->size = feed->replica_sizes[sibling];
+      memcpy(uncle->hash, feed->replica_hashes[sibling], HASH_BYTES);
+    } else if (level < message->nodes_length && sibling == message->nodes[level].index) {
+      memcpy(uncle, &message->nodes[level], sizeof(*uncle));
+    } else {
+      return -1;
+    }
+
+    hashes[0] = (hypercore_crypto_buffer_t) { HASH_BYTES, path[length - 2].hash };
+    hashes[1] = (hypercore_crypto_buffer_t) { HASH_BYTES, uncle->hash };
+    nodes[0] = (hypercore_crypto_node_t) { index, size, &hashes[0], 0 };
+    nodes[1] = (hypercore_crypto_node_t) { sibling, uncle->size, &hashes[1], 0 };
+
+    if (index < sibling) {
+      hypercore_crypto_parent(&out, &nodes[0], &nodes[1]);
+    } else {
+      hypercore_crypto_parent(&out, &nodes[1], &nodes[0]);
+    }
+
+    index = ft_parent(index, 0);
+    size += uncle->size;
+  }
+
+  for (unsigned long int i = 0; i < length; ++i) {
+    trust(feed, path[i].index, path[i].size, path[i].hash);
+  }
+
+  return 0;
+}
+
+/**
+ * Delivers every block of every feed to the replica. Feeds interleave
+ * and each block comes from one of the peers that has it.
+ */
+static int
+replicate(feed_t *feeds, const options_t *options, stats_t *stats) {
+  static message_t message;
+  unsigned long long sequence = 0;
+
+  for (unsigned long int i = 0; i < options->blocks; ++i) {
+    for (unsigned long int f = 0; f < options->feeds; ++f) {
+      unsigned long int block = feeds[f].order[i];
+      unsigned long int first = 0;
+
+      while (peer_length(options, first) <= block) {
+        first++;
+      }
+
+      prepare(&message, &feeds[f], options, first + sequence++ % (options->peers - first), block);
+
+      unsigned long long begin = now();
+
+      if (0 != verify(&message, stats)) {
+        fprintf(stderr, "error: block %lu of feed %lu failed to verify\n", block, f);
+        return -1;
+      }
+
+      stats->latencies[stats->count++] = now() - begin;
+      stats->bytes += message.size;
+      stats->proof_bytes +=
+        (message.nodes_length + message.roots_length) * (HASH_BYTES + 16) +
+        SIGNATURE_BYTES;
+    }
+  }
+
+  return 0;
+}
+
+static int
+compare(const void *a, const void *b) {
+  unsigned long long x = *(const unsigned long long *) a;
+  unsigned long long y = *(const unsigned long long *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+print_stats(const char *name, stats_t *stats, int last) {
+  static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  static const char *labels[] = { "p50", "p90", "p99", "p999" };
+  unsigned long long sum = 0;
+  double seconds = 0;
+
+  qsort(stats->latencies, stats->count, sizeof(*stats->latencies), compare);
+
+  for (unsigned long long i = 0; i < stats->count; ++i) {
+    sum += stats->latencies[i];
+  }
+
+  // building the messages of the simulated peers is not counted
+  seconds = sum / 1e9;
+
+  printf("  \"%s\": {", name);
+  printf(" \"blocks\": %llu,", stats->count);
+  printf(" \"bytes\": %llu,", stats->bytes);
+  printf(" \"signatures\": %llu,", stats->signatures);
+
+  if (stats->proof_bytes > 0) {
+    printf(" \"proof_bytes_per_block\": %.2f,", (double) stats->proof_bytes / stats->count);
+  }
+
+  printf(" \"blocks_per_sec\": %.2f,", stats->count / seconds);
+  printf(" \"bytes_per_sec\": %.2f,", stats->bytes / seconds);
+  printf(" \"mean_ns\": %.2f", (double) sum / stats->count);
+
+  for (int i = 0; i < 4; ++i) {
+    printf(", \"%s_ns\": %llu", labels[i],
+      stats->latencies[(unsigned long long) (quantiles[i] * (stats->count - 1))]);
+  }
+
+  printf(", \"max_ns\": %llu }%s\n", stats->latencies[stats->count - 1], last ? "" : ",");
+}
+
+static void
+usage(const char *name) {
+  fprintf(stderr,
+    "usage: %s [--feeds=M] [--blocks=N] [--block-size=BYTES|MIN-MAX]\n"
+    "       [--peers=P] [--order=sequential|reverse|random|strided] [--seed=S]\n",
+    name);
+}
+
+int
+main(int argc, char **argv) {
+  options_t options = { 4, 4096, 1024, 1024, 4, ORDER_RANDOM, 1 };
+  stats_t writes = { 0 };
+  stats_t reads = { 0 };
+  feed_t *feeds = 0;
+  int rc = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (0 == strncmp(argv[i], "--feeds=", 8)) {
+      options.feeds = strtoul(argv[i] + 8, 0, 10);
+    } else if (0 == strncmp(argv[i], "--blocks=", 9)) {
+      options.blocks = strtoul(argv[i] + 9, 0, 10);
+    } else if (0 == strncmp(argv[i], "--block-size=", 13)) {
+      char *end = 0;
+      options.min_size = strtoul(argv[i] + 13, &end, 10);
+      options.max_size = '-' == *end ? strtoul(end + 1, 0, 10) : options.min_size;
+    } else if (0 == strncmp(argv[i], "--peers=", 8)) {
+      options.peers = strtoul(argv[i] + 8, 0, 10);
+    } else if (0 == strncmp(argv[i], "--order=", 8)) {
+      for (options.order = 0; options.order < ORDER_MAX; ++options.order) {
+        if (0 == strcmp(argv[i] + 8, orders[options.order])) {
+          break;
+        }
+      }
+    } else if (0 == strncmp(argv[i], "--seed=", 7)) {
+      options.seed = strtoull(argv[i] + 7, 0, 10);
+    } else if (0 == strcmp(argv[i], "--help")) {
+      usage(argv[0]);
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (
+    0 == options.feeds ||
+    0 == options.blocks ||
+    0 == options.peers ||
+    0 == options.min_size ||
+    options.max_size < options.min_size ||
+    ORDER_MAX == options.order
+  ) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  state = options.seed ? options.seed : 1;
+  feeds = calloc(options.feeds, sizeof(*feeds));
+  writes.latencies = calloc(options.feeds * options.blocks, sizeof(*writes.latencies));
+  reads.latencies = calloc(options.feeds * options.blocks, sizeof(*reads.latencies));
+
+  if (0 == feeds || 0 == writes.latencies || 0 == reads.latencies) {
+    return 1;
+  }
+
+  for (unsigned long int f = 0; 0 == rc && f < options.feeds; ++f) {
+    if (0 != feed_init(&feeds[f], &options)) {
+      fprintf(stderr, "error: failed to initialize feed\n");
+      rc = 1;
+    } else if (0 != append(&feeds[f], &options, &writes)) {
+      fprintf(stderr, "error: failed to append to feed %lu\n", f);
+      rc = 1;
+    } else {
+      order(&feeds[f], &options);
+    }
+  }
+
+  if (0 == rc && 0 != replicate(feeds, &options, &reads)) {
+    rc = 1;
+  }
+
+  if (0 == rc) {
+    printf("{\n");
+    printf("  \"version\": \"%s\",\n", hypercore_crypto_version_string());
+    printf("  \"feeds\": %lu,\n", options.feeds);
+    printf("  \"blocks\": %lu,\n", options.blocks);
+    printf("  \"block_size\": [%lu, %lu],\n", options.min_size, options.max_size);
+    printf("  \"peers\": %lu,\n", options.peers);
+    printf("  \"order\": \"%s\",\n", orders[options.order]);
+    printf("  \"seed\": %llu,\n", options.seed);
+    print_stats("append", &writes, 0);
+    print_stats("verify", &reads, 1);
+    printf("}\n");
+  }
+
+  for (unsigned long int f = 0; f < options.feeds; ++f) {
+    feed_destroy(&feeds[f]);
+  }
+
+  free(writes.latencies);
+  free(reads.latencies);
+  free(feeds);
+  return rc;
+}
@@ -1,5 +1,7 @@
 #include "merkle/allocator.h"
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef MERKLE_ALLOCATOR_ALLOC
 #define MERKLE_ALLOCATOR_ALLOC 0
@@ -17,30 +19,150 @@ static void *(*alloc)(unsigned long int) = MERKLE_ALLOCATOR_ALLOC;
 static void *(*re_alloc)(void *, unsigned long int) = MERKLE_ALLOCATOR_REALLOC;
 static void (*dealloc)(void *) = MERKLE_ALLOCATOR_FREE;
 
-static struct merkle_allocator_stats_s stats = { 0 };
+// live blocks kept by a thread before they are folded into `live`
+#ifndef MERKLE_ALLOCATOR_STATS_BATCH
+#define MERKLE_ALLOCATOR_STATS_BATCH 64
+#endif
+
+/**
+ * Counters owned by one thread. Only the owner writes them, other
+ * threads read them while aggregating.
+ */
+struct shard {
+  unsigned long long realloc;
+  unsigned long long alloc;
+  unsigned long long free;
+  long long delta;
+  int registered;
+  struct shard *next;
+};
+
+static MERKLE_THREAD_LOCAL struct shard shard = { 0 };
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static struct shard *shards = 0;
+static struct shard retired = { 0 };
+
+static long long live = 0;
+static long long peak = 0;
+
+#define load(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define store(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static void
+flush(struct shard *local) {
+  long long current = __atomic_add_fetch(&live, load(local->delta), __ATOMIC_RELAXED);
+  long long highest = load(peak);
+
+  store(local->delta, 0);
+
+  while (
+    current > highest &&
+    !__atomic_compare_exchange_n(
+      &peak, &highest, current, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+  ) {
+    continue;
+  }
+}
+
+static void
+retire(void *ptr) {
+  struct shard *local = ptr;
+
+  pthread_mutex_lock(&mutex);
+  flush(local);
+  retired.realloc += local->realloc;
+  retired.alloc += local->alloc;
+  retired.free += local->free;
+
+  for (struct shard **link = &shards; 0 != *link; link = &(*link)->next) {
+    if (local == *link) {
+      *link = local->next;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&mutex);
+  memset(local, 0, sizeof(*local));
+}
+
+static void
+init() {
+  pthread_key_create(&key, retire);
+}
+
+static struct shard *
+local_shard() {
+  if (0 == shard.registered) {
+    pthread_once(&once, init);
+    pthread_mutex_lock(&mutex);
+    shard.registered = 1;
+    shard.next = shards;
+    shards = &shard;
+    pthread_mutex_unlock(&mutex);
+    pthread_setspecific(key, &shard);
+  }
+
+  return &shard;
+}
+
+static void
+count(unsigned long long *counter, long long blocks) {
+  struct shard *local = local_shard();
+  long long delta = local->delta + blocks;
+
+  store(*counter, *counter + 1);
+  store(local->delta, delta);
+
+  if (delta > MERKLE_ALLOCATOR_STATS_BATCH || delta < -MERKLE_ALLOCATOR_STATS_BATCH) {
+    flush(local);
+  }
+}
 
 const struct merkle_allocator_stats_s
 merkle_allocator_stats() {
-  return (struct merkle_allocator_stats_s) {
-    .realloc = stats.realloc,
-    .alloc = stats.alloc,
-    .free = stats.free
-  };
+  struct merkle_allocator_stats_s stats = { 0 };
+  long long current = 0;
+  long long highest = 0;
+
+  pthread_mutex_lock(&mutex);
+
+  stats.realloc = retired.realloc;
+  stats.alloc = retired.alloc;
+  stats.free = retired.free;
+  current = load(live);
+  highest = load(peak);
+
+  for (struct shard *local = shards; 0 != local; local = local->next) {
+    stats.realloc += load(local->realloc);
+    stats.alloc += load(local->alloc);
+    stats.free += load(local->free);
+    current += load(local->delta);
+  }
+
+  pthread_mutex_unlock(&mutex);
+
+  stats.current = current > 0 ? (unsigned long long) current : 0;
+  stats.peak = highest > current ? highest : stats.current;
+
+  return stats;
 }
 
-int
+unsigned long long
 merkle_allocator_alloc_count() {
-  return stats.alloc;
+  return merkle_allocator_stats().alloc;
 }
 
-int
+unsigned long long
 merkle_allocator_realloc_count() {
-  return stats.realloc;
+  return merkle_allocator_stats().realloc;
 }
 
-int
+unsigned long long
 merkle_allocator_free_count() {
-  return stats.free;
+  return merkle_allocator_stats().free;
 }
 
 void
@@ -60,26 +182,34 @@ merkle_deallocator_set(void (*deallocator)(void *)) {
 
 void *
 merkle_alloc(unsigned long int size) {
+  void *ptr = 0;
+
   if (0 == size) {
     return 0;
   } else if (0 != alloc) {
-    (void) stats.alloc++;
-    return alloc(size);
+    ptr = alloc(size);
   } else {
-    (void) stats.alloc++;
-    return malloc(size);
+    ptr = malloc(size);
+  }
+
+  if (0 != ptr) {
+    count(&local_shard()->alloc, 1);
   }
+
+  return ptr;
 }
 
 void *
 merkle_realloc(void *ptr, unsigned long int size) {
   if (0 == ptr || 0 == size) {
     return 0;
-  } else if (0 != re_alloc) {
-    (void) stats.realloc++;
+  }
+
+  count(&local_shard()->realloc, 0);
+
+  if (0 != re_alloc) {
     return re_alloc(ptr, size);
   } else {
-    (void) stats.realloc++;
     return realloc(ptr, size);
   }
 }
@@ -88,11 +218,13 @@ void
 merkle_free(void *ptr) {
   if (0 == ptr) {
     return;
-  } else if (0 != dealloc) {
-    (void) stats.free++;
+  }
+
+  count(&local_shard()->free, -1);
+
+  if (0 != dealloc) {
     dealloc(ptr);
   } else {
-    (void) stats.free++;
     free(ptr);
   }
 }
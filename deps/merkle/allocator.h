@@ -7,16 +7,19 @@
 struct merkle_allocator_stats_s;
 
 /**
- * Allocator stats
+ * Allocator stats. `current` and `peak` count live blocks, sizes are not
+ * known to `merkle_free()` as codecs may hand it their own buffers.
  */
 struct merkle_allocator_stats_s {
-  unsigned int realloc;
-  unsigned int alloc;
-  unsigned int free;
+  unsigned long long realloc;
+  unsigned long long alloc;
+  unsigned long long free;
+  unsigned long long current;
+  unsigned long long peak;
 };
 
 /**
- * Returns allocator stats.
+ * Returns allocator stats summed over every thread.
  */
 MERKLE_EXPORT const struct merkle_allocator_stats_s
 merkle_allocator_stats();
@@ -24,13 +27,13 @@ merkle_allocator_stats();
 /**
  * Returns number of allocations returned by `merkle_alloc()`.
  */
-MERKLE_EXPORT int
+MERKLE_EXPORT unsigned long long
 merkle_allocator_alloc_count();
 
 /**
  * Returns number of deallocations by `merkle_free()`.
  */
-MERKLE_EXPORT int
+MERKLE_EXPORT unsigned long long
 merkle_allocator_free_count();
 
 /**
@@ -9,12 +9,29 @@
 #include "merkle/allocator.h"
 #include "merkle/merkle.h"
 
+// USDT probes under the `merkle` provider, a `nop` until traced
+#if defined(MERKLE_HAVE_SYS_SDT_H) && !defined(MERKLE_NO_PROBES)
+#include <sys/sdt.h>
+#define PROBE2(name, a, b) DTRACE_PROBE2(merkle, name, a, b)
+#else
+#define PROBE2(name, a, b) ((void) 0)
+#endif
+
+// initial capacity of a node list
+#define MIN_CAPACITY 8
+
 static unsigned long int
 push(merkle_node_list_t *nodes, merkle_node_t *node);
 
 static merkle_node_t *
 pop(merkle_node_list_t *nodes);
 
+static merkle_node_list_t *
+node_list(merkle_node_list_t *nodes);
+
+static merkle_node_t *
+copy(merkle_node_t *node);
+
 static unsigned long int
 default_node_callback(
   unsigned char **hash,
@@ -59,11 +76,12 @@ merkle_init(merkle_t *merkle, merkle_options_t options) {
 
   merkle->blocks = 0;
   merkle->codec = options.codec;
+  merkle->lazy = 0 != options.lazy;
 
   merkle->roots.length = 0;
   merkle->roots.alloc = 0;
-  merkle->roots.list = merkle_alloc(sizeof(merkle_node_t));
-  memset(merkle->roots.list, 0, sizeof(merkle_node_t));
+  merkle->roots.list = merkle_alloc(MIN_CAPACITY * sizeof(merkle_node_t *));
+  memset(merkle->roots.list, 0, MIN_CAPACITY * sizeof(merkle_node_t *));
   return 0;
 }
 
@@ -84,15 +102,12 @@ merkle_next(
     return 0;
   }
 
-  if (0 == nodes) {
-    nodes = merkle_alloc(sizeof(*nodes));
-    nodes->length = 0;
-    nodes->alloc = 1;
-    nodes->list = 0;
-  }
+  nodes = node_list(nodes);
 
   unsigned int index = 2 * merkle->blocks++;
 
+  PROBE2(next__entry, index, size);
+
   // returned to and managed by (destroyed) caller
   merkle_node_t *node = merkle_alloc(sizeof(*node));
   memset(node, 0, sizeof(*node));
@@ -107,17 +122,7 @@ merkle_next(
   node->hash_size = merkle->codec.node(&node->hash, node, &merkle->roots);
 
   // private reference and managed by (destroyed) by `merkle_t`
-  merkle_node_t *root = merkle_alloc(sizeof(*root));
-  memset(root, 0, sizeof(*root));
-  memcpy(root, node, sizeof(*root));
-
-  // reset `ref`
-  root->ref = 0;
-
-  // make copy of hash
-  root->hash = merkle_alloc(node->hash_size);
-  memset(root->hash, 0, node->hash_size);
-  memcpy(root->hash, node->hash, node->hash_size);
+  merkle_node_t *root = copy(node);
 
   // append to `node` to `nodes`
   push(nodes, node);
@@ -125,8 +130,8 @@ merkle_next(
   // append `root` from `node` to merkle roots array
   push(&merkle->roots, root);
 
-  // compture hashes for parents
-  while (merkle->roots.length > 1) {
+  // compture hashes for parents, deferred to `merkle_flush()` if lazy
+  while (0 == merkle->lazy && merkle->roots.length > 1) {
     unsigned long int length = merkle->roots.length;
     merkle_node_t *left = merkle->roots.list[length - 2];
     merkle_node_t *right = merkle->roots.list[length - 1];
@@ -158,22 +163,114 @@ merkle_next(
     merkle_node_destroy(root);
 
     // compute next private reference and managed by (destroyed) by `merkle_t`
-    root = merkle_alloc(sizeof(*root));
-    memset(root, 0, sizeof(*root));
-    memcpy(root, node, sizeof(*root));
-
-    // reset `ref`
-    root->ref = 0;
-
-    // make copy of hash
-    root->hash = merkle_alloc(node->hash_size);
-    memset(root->hash, 0, node->hash_size);
-    memcpy(root->hash, node->hash, node->hash_size);
+    root = copy(node);
 
     merkle_node_destroy(pop(&merkle->roots));
     push(&merkle->roots, root);
   }
 
+  PROBE2(next__return, index, nodes->length);
+
+  return nodes;
+}
+
+merkle_node_list_t *
+merkle_flush(merkle_t *merkle, merkle_node_list_t *nodes) {
+  if (0 == merkle) {
+    errno = EFAULT;
+    return 0;
+  }
+
+  nodes = node_list(nodes);
+
+  // each pass hashes every sibling pair of roots, which is one level
+  // for a run of appended leaves
+  while (1) {
+    merkle_node_t **list = merkle->roots.list;
+    unsigned long int length = merkle->roots.length;
+    unsigned long int count = 0;
+    unsigned long int hash_size = 0;
+
+    for (unsigned long int i = 0; i + 1 < length; ++i) {
+      if (list[i]->parent == list[i + 1]->parent) {
+        count++;
+        i++;
+      }
+    }
+
+    if (0 == count) {
+      break;
+    }
+
+    merkle_node_t **pairs = merkle_alloc(2 * count * sizeof(*pairs));
+    unsigned char **hashes = merkle_alloc(count * sizeof(*hashes));
+
+    if (0 == pairs || 0 == hashes) {
+      merkle_free(pairs);
+      merkle_free(hashes);
+      errno = ENOMEM;
+      return 0;
+    }
+
+    for (unsigned long int i = 0, k = 0; i + 1 < length; ++i) {
+      if (list[i]->parent == list[i + 1]->parent) {
+        pairs[k++] = list[i];
+        pairs[k++] = list[++i];
+      }
+    }
+
+    if (0 != merkle->codec.parents) {
+      hash_size = merkle->codec.parents(hashes, pairs, count);
+    } else {
+      for (unsigned long int k = 0; k < count; ++k) {
+        hash_size = merkle->codec.parent(&hashes[k], pairs[2 * k], pairs[2 * k + 1]);
+      }
+    }
+
+    // replace each pair with its parent in place
+    unsigned long int j = 0;
+
+    for (unsigned long int i = 0, k = 0; i < length; ++i, ++j) {
+      if (k == count || list[i] != pairs[2 * k]) {
+        list[j] = list[i];
+        continue;
+      }
+
+      merkle_node_t *left = list[i];
+      merkle_node_t *right = list[++i];
+      merkle_node_t *node = merkle_alloc(sizeof(*node));
+      memset(node, 0, sizeof(*node));
+
+      node->alloc = 1;
+      node->parent = ft_parent(left->parent, 0);
+      node->index = left->parent;
+      node->size = left->size + right->size;
+      node->data = 0;
+      node->hash = hashes[k++];
+      node->hash_size = hash_size;
+
+      push(nodes, node);
+
+      list[j] = copy(node);
+      list[j]->ref = 1;
+
+      // release the references held by `merkle->roots`
+      left->ref--;
+      right->ref--;
+      merkle_node_destroy(left);
+      merkle_node_destroy(right);
+    }
+
+    for (unsigned long int i = j; i < length; ++i) {
+      list[i] = 0;
+    }
+
+    merkle->roots.length = j;
+
+    merkle_free(pairs);
+    merkle_free(hashes);
+  }
+
   return nodes;
 }
 
@@ -222,17 +319,52 @@ merkle_node_list_destroy(merkle_node_list_t *nodes) {
   }
 }
 
+static merkle_node_list_t *
+node_list(merkle_node_list_t *nodes) {
+  if (0 == nodes) {
+    nodes = merkle_alloc(sizeof(*nodes));
+    nodes->length = 0;
+    nodes->alloc = 1;
+    nodes->list = 0;
+  }
+
+  return nodes;
+}
+
+static merkle_node_t *
+copy(merkle_node_t *node) {
+  merkle_node_t *root = merkle_alloc(sizeof(*root));
+  memcpy(root, node, sizeof(*root));
+
+  // reset `ref`
+  root->ref = 0;
+
+  // make copy of hash
+  root->hash = merkle_alloc(node->hash_size);
+  memcpy(root->hash, node->hash, node->hash_size);
+
+  return root;
+}
+
 static unsigned long int
 push(merkle_node_list_t *nodes, merkle_node_t *node) {
+  unsigned long int length = nodes->length;
+
+  // capacity doubles each time `length` reaches a power of two
   if (0 == nodes->list) {
-    nodes->list = merkle_alloc(sizeof(merkle_node_t));
-    memset(nodes->list, 0, sizeof(merkle_node_t));
-  } else if (0 == nodes->list[nodes->length]) {
+    nodes->list = merkle_alloc(MIN_CAPACITY * sizeof(merkle_node_t *));
+
+    if (0 == nodes->list) {
+      return 0;
+    }
+
+    memset(nodes->list, 0, MIN_CAPACITY * sizeof(merkle_node_t *));
+  } else if (length >= MIN_CAPACITY && 0 == (length & (length - 1))) {
     merkle_node_t **list = merkle_realloc(
       nodes->list,
-      (nodes->length + 1) * sizeof(merkle_node_t));
+      2 * length * sizeof(merkle_node_t *));
 
-    if (0 == nodes) {
+    if (0 == list) {
       return 0;
     }
 
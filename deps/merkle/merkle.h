@@ -21,15 +21,33 @@ typedef unsigned long int (merkle_parent_callback_t)(
   merkle_node_t *left,
   merkle_node_t *right);
 
+/**
+ * Computes the parent hashes of `count` sibling pairs at once, where
+ * `pairs[2 * i]` and `pairs[2 * i + 1]` are the left and right node of
+ * `hashes[i]`. Optional, `merkle_flush()` calls `parent` for each pair
+ * without it.
+ */
+typedef unsigned long int (merkle_parents_callback_t)(
+  unsigned char **hashes,
+  merkle_node_t **pairs,
+  unsigned long int count);
+
 #define MERKLE_DEFAULT_OPTIONS ((merkle_options_t) { 0 })
 
 struct merkle_codec {
   merkle_node_callback_t *node;
   merkle_parent_callback_t *parent;
+  merkle_parents_callback_t *parents;
 };
 
+/**
+ * With `lazy` set, `merkle_next()` only hashes the appended leaf and
+ * parents are computed by `merkle_flush()`, which must be called before
+ * reading `roots`.
+ */
 struct merkle_options {
   merkle_codec_t codec;
+  int lazy;
 };
 
 struct merkle_node {
@@ -51,6 +69,7 @@ struct merkle_node_list {
 
 struct merkle {
   unsigned int alloc:1;
+  unsigned int lazy:1;
   merkle_node_list_t roots;
   unsigned long int blocks;
   merkle_codec_t codec;
@@ -69,6 +88,14 @@ merkle_next(
   unsigned long int size,
   merkle_node_list_t *nodes);
 
+/**
+ * Computes every parent deferred by a lazy `merkle_t`, one tree level
+ * per pass, and appends them to `nodes`. The roots and nodes are the
+ * same as those of `merkle_next()` without `lazy`.
+ */
+MERKLE_EXPORT merkle_node_list_t *
+merkle_flush(merkle_t *merkle, merkle_node_list_t *nodes);
+
 MERKLE_EXPORT void
 merkle_node_destroy(merkle_node_t *node);
 
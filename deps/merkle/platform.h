@@ -11,6 +11,14 @@
 #  define MERKLE_INLINE
 #endif
 
+#ifndef MERKLE_THREAD_LOCAL
+#  if defined(_MSC_VER)
+#    define MERKLE_THREAD_LOCAL __declspec(thread)
+#  else
+#    define MERKLE_THREAD_LOCAL __thread
+#  endif
+#endif
+
 #ifndef MERKLE_ALIGNMENT
 #  define MERKLE_ALIGNMENT sizeof(unsigned long) // platform word
 #endif
@@ -0,0 +1,246 @@
+#ifndef HYPERCORE_CRYPTO_HPP
+#define HYPERCORE_CRYPTO_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <span>
+
+#include "crypto/crypto.h"
+
+namespace hypercore::crypto {
+
+using byte_span = std::span<const std::byte>;
+
+using hash = std::array<std::uint8_t, hypercore_crypto_data_BYTES>;
+using public_key = std::array<std::uint8_t, 32>;
+using signature = std::array<std::uint8_t, 64>;
+using seed = std::array<std::uint8_t, 32>;
+
+// a merkle tree over 64 bit indices never has more roots than this
+constexpr std::size_t max_roots = 64;
+
+/**
+ * An ed25519 secret key held by value and zeroed when destroyed or
+ * moved from.
+ */
+class secret_key {
+public:
+  secret_key() noexcept = default;
+  ~secret_key() { clear(); }
+
+  secret_key(const secret_key &) = delete;
+  secret_key &operator=(const secret_key &) = delete;
+
+  secret_key(secret_key &&other) noexcept : bytes_(other.bytes_) {
+    other.clear();
+  }
+
+  secret_key &operator=(secret_key &&other) noexcept {
+    if (this != &other) {
+      bytes_ = other.bytes_;
+      other.clear();
+    }
+
+    return *this;
+  }
+
+  std::uint8_t *data() noexcept { return bytes_.data(); }
+  const std::uint8_t *data() const noexcept { return bytes_.data(); }
+  static constexpr std::size_t size() noexcept { return 64; }
+
+  void clear() noexcept {
+    volatile std::uint8_t *bytes = bytes_.data();
+    for (std::size_t i = 0; i < bytes_.size(); ++i) {
+      bytes[i] = 0;
+    }
+  }
+
+private:
+  std::array<std::uint8_t, 64> bytes_ = {};
+};
+
+struct keypair {
+  crypto::public_key public_key = {};
+  crypto::secret_key secret_key;
+};
+
+struct node {
+  std::uint64_t index = 0;
+  std::uint64_t size = 0;
+  crypto::hash hash = {};
+};
+
+/**
+ * Routes every library allocation made by the calling thread through a
+ * `std::pmr::memory_resource` for the lifetime of the scope, for example
+ * a `std::pmr::monotonic_buffer_resource` per request. Scopes nest and
+ * memory is returned to the resource it came from even when freed in
+ * another scope, but must be freed before its scope ends. Merkle trees
+ * allocate through the same scopes once `merkle_allocator_set()` and
+ * friends are given `hypercore_crypto_alloc()`, `hypercore_crypto_realloc()`
+ * and `hypercore_crypto_free()`.
+ */
+class allocator_scope {
+public:
+  explicit allocator_scope(std::pmr::memory_resource &resource) noexcept
+    : allocator_({ &resource, allocate, deallocate, nullptr }) {
+    hypercore_crypto_allocator_push(&allocator_);
+  }
+
+  ~allocator_scope() { hypercore_crypto_allocator_pop(); }
+
+  allocator_scope(const allocator_scope &) = delete;
+  allocator_scope &operator=(const allocator_scope &) = delete;
+
+private:
+  // the size is kept in front of each block for `deallocate()`
+  static constexpr std::size_t header = alignof(std::max_align_t);
+
+  static void *
+  allocate(void *ctx, unsigned long int size) noexcept {
+    auto *resource = static_cast<std::pmr::memory_resource *>(ctx);
+
+    try {
+      auto *bytes = static_cast<unsigned char *>(
+        resource->allocate(header + size, alignof(std::max_align_t)));
+
+      *reinterpret_cast<std::size_t *>(bytes) = size;
+      return bytes + header;
+    } catch (const std::bad_alloc &) {
+      return nullptr;
+    }
+  }
+
+  static void
+  deallocate(void *ctx, void *ptr) noexcept {
+    auto *resource = static_cast<std::pmr::memory_resource *>(ctx);
+    auto *bytes = static_cast<unsigned char *>(ptr) - header;
+    std::size_t size = *reinterpret_cast<std::size_t *>(bytes);
+
+    resource->deallocate(bytes, header + size, alignof(std::max_align_t));
+  }
+
+  hypercore_crypto_allocator_t allocator_;
+};
+
+namespace detail {
+
+// C buffer descriptors pointing at caller memory, nothing is copied
+inline hypercore_crypto_buffer_t
+buffer(byte_span bytes) noexcept {
+  return {
+    bytes.size(),
+    reinterpret_cast<unsigned char *>(const_cast<std::byte *>(bytes.data()))
+  };
+}
+
+template <std::size_t N>
+inline hypercore_crypto_buffer_t
+buffer(const std::array<std::uint8_t, N> &bytes) noexcept {
+  return { N, const_cast<unsigned char *>(bytes.data()) };
+}
+
+inline hypercore_crypto_buffer_t
+buffer(const crypto::secret_key &key) noexcept {
+  return { key.size(), const_cast<unsigned char *>(key.data()) };
+}
+
+} // namespace detail
+
+/**
+ * Generates a keypair, from `seed` if given, into `out`.
+ */
+inline int
+generate(keypair &out, const crypto::seed *seed = nullptr) noexcept {
+  hypercore_crypto_keypair_t kp = {
+    detail::buffer(out.public_key),
+    detail::buffer(out.secret_key)
+  };
+
+  return hypercore_crypto_keypair(&kp, nullptr == seed ? nullptr : seed->data());
+}
+
+inline int
+sign(signature &out, byte_span message, const secret_key &key) noexcept {
+  hypercore_crypto_buffer_t signature = detail::buffer(out);
+  hypercore_crypto_buffer_t msg = detail::buffer(message);
+  hypercore_crypto_buffer_t sk = detail::buffer(key);
+  return hypercore_crypto_sign(&signature, &msg, &sk);
+}
+
+inline bool
+verify(const signature &sig, byte_span message, const public_key &key) noexcept {
+  hypercore_crypto_buffer_t signature = detail::buffer(sig);
+  hypercore_crypto_buffer_t msg = detail::buffer(message);
+  hypercore_crypto_buffer_t pk = detail::buffer(key);
+  return 0 == hypercore_crypto_verify(&signature, &msg, &pk);
+}
+
+inline int
+data(hash &out, byte_span data) noexcept {
+  hypercore_crypto_buffer_t hash = detail::buffer(out);
+  hypercore_crypto_buffer_t input = detail::buffer(data);
+  return hypercore_crypto_data(&hash, &input);
+}
+
+inline int
+parent(hash &out, const node &left, const node &right) noexcept {
+  hypercore_crypto_buffer_t hash = detail::buffer(out);
+  hypercore_crypto_buffer_t hashes[2] = {
+    detail::buffer(left.hash),
+    detail::buffer(right.hash)
+  };
+
+  hypercore_crypto_node_t nodes[2] = {
+    { left.index, left.size, &hashes[0], nullptr },
+    { right.index, right.size, &hashes[1], nullptr }
+  };
+
+  return hypercore_crypto_parent(&hash, &nodes[0], &nodes[1]);
+}
+
+/**
+ * Computes the tree hash of at most `max_roots` roots.
+ */
+inline int
+tree(hash &out, std::span<const node> roots) noexcept {
+  if (roots.size() > max_roots) {
+    return -EINVAL;
+  }
+
+  hypercore_crypto_buffer_t hash = detail::buffer(out);
+  hypercore_crypto_buffer_t hashes[max_roots];
+  hypercore_crypto_node_t nodes[max_roots];
+  const hypercore_crypto_node_t *list[max_roots];
+
+  for (std::size_t i = 0; i < roots.size(); ++i) {
+    hashes[i] = detail::buffer(roots[i].hash);
+    nodes[i] = { roots[i].index, roots[i].size, &hashes[i], nullptr };
+    list[i] = &nodes[i];
+  }
+
+  return hypercore_crypto_tree(&hash, list, roots.size());
+}
+
+inline int
+discovery_key(hash &out, const public_key &key) noexcept {
+  hypercore_crypto_buffer_t hash = detail::buffer(out);
+  hypercore_crypto_buffer_t pk = detail::buffer(key);
+  int rc = hypercore_crypto_discoverykey(&hash, &pk);
+  return rc < 0 ? rc : 0;
+}
+
+inline int
+randombytes(std::span<std::uint8_t> out) noexcept {
+  hypercore_crypto_buffer_t buffer = { out.size(), out.data() };
+  int rc = out.empty() ? 0 : hypercore_crypto_randombytes(&buffer);
+  return rc < 0 ? rc : 0;
+}
+
+} // namespace hypercore::crypto
+
+#endif
@@ -3,19 +3,49 @@
 
 #include "platform.h"
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 // Forward declarations
 struct hypercore_crypto_allocator_stats_s;
+struct hypercore_crypto_allocator;
+
+typedef struct hypercore_crypto_allocator hypercore_crypto_allocator_t;
+
+/**
+ * Bytes in front of every `hypercore_crypto_alloc()` block, so a scope
+ * is asked for this much more than the caller requested.
+ */
+#define HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES 16
 
 /**
- * Allocator stats
+ * A context bound allocator that can be scoped to the calling thread
+ * with `hypercore_crypto_allocator_push()`.
+ */
+struct hypercore_crypto_allocator {
+  void *ctx;
+  void *(*alloc)(void *ctx, unsigned long int size);
+  void (*free)(void *ctx, void *ptr);
+  hypercore_crypto_allocator_t *previous;
+};
+
+/**
+ * Allocator stats. `current` and `peak` are live bytes requested
+ * through `hypercore_crypto_alloc()`.
  */
 struct hypercore_crypto_allocator_stats_s {
-  unsigned int alloc;
-  unsigned int free;
+  unsigned long long alloc;
+  unsigned long long free;
+  unsigned long long current;
+  unsigned long long peak;
 };
 
 /**
- * Returns allocator stats.
+ * Returns allocator stats summed over every thread. Threads count into
+ * their own counters and only publish live bytes in batches of
+ * `HYPERCORE_CRYPTO_ALLOCATOR_STATS_BATCH`, so `peak` may trail the true
+ * peak by up to that much per thread.
  */
 HYPERCORE_CRYPTO_EXPORT const struct hypercore_crypto_allocator_stats_s
 hypercore_crypto_allocator_stats();
@@ -23,13 +53,13 @@ hypercore_crypto_allocator_stats();
 /**
  * Returns number of allocations returned by `hypercore_crypto_alloc()`.
  */
-HYPERCORE_CRYPTO_EXPORT int
+HYPERCORE_CRYPTO_EXPORT unsigned long long
 hypercore_crypto_allocator_alloc_count();
 
 /**
  * Returns number of deallocations by `hypercore_crypto_free()`.
  */
-HYPERCORE_CRYPTO_EXPORT int
+HYPERCORE_CRYPTO_EXPORT unsigned long long
 hypercore_crypto_allocator_free_count();
 
 /**
@@ -47,17 +77,50 @@ HYPERCORE_CRYPTO_EXPORT void
 hypercore_crypto_deallocator_set(void (*allocator)(void *));
 
 /**
- * The allocator function used in the library.
- * Defaults to `malloc()`.
+ * Makes `allocator` serve every `hypercore_crypto_alloc()` call on the
+ * calling thread until the matching `hypercore_crypto_allocator_pop()`.
+ * Scopes nest. Each block records the scope it came from and
+ * `hypercore_crypto_free()` returns it there, from any scope, so
+ * `allocator` must outlive the memory it served. Secret keys are never
+ * allocated through a scope.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_allocator_push(hypercore_crypto_allocator_t *allocator);
+
+/**
+ * Ends the innermost allocator scope of the calling thread.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_allocator_pop();
+
+/**
+ * The allocator function used in the library. Uses the innermost scope
+ * of the calling thread, then the allocator set with
+ * `hypercore_crypto_allocator_set()`, then `sodium_malloc()` once the
+ * library is initialized, and `malloc()` before that.
  */
 HYPERCORE_CRYPTO_EXPORT void *
 hypercore_crypto_alloc(unsigned long int);
 
 /**
- * The deallocator function used in the library.
- * Defaults to `free()`.
+ * Resizes a block from `hypercore_crypto_alloc()`, allocating the new
+ * block like `hypercore_crypto_alloc()` does. Together with it and
+ * `hypercore_crypto_free()` it can be given to `merkle_allocator_set()`,
+ * `merkle_reallocator_set()` and `merkle_deallocator_set()` so merkle
+ * trees allocate through the same scopes as the library.
+ */
+HYPERCORE_CRYPTO_EXPORT void *
+hypercore_crypto_realloc(void *, unsigned long int);
+
+/**
+ * The deallocator function used in the library. Returns the block to
+ * the scope or allocator that served it.
  */
 HYPERCORE_CRYPTO_EXPORT void
 hypercore_crypto_free(void *);
 
+#if defined(__cplusplus)
+}
+#endif
+
 #endif
@@ -0,0 +1,88 @@
+#ifndef HYPERCORE_CRYPTO_ARENA_H
+#define HYPERCORE_CRYPTO_ARENA_H
+
+#include "allocator.h"
+#include "platform.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct hypercore_crypto_arena hypercore_crypto_arena_t;
+
+#ifndef HYPERCORE_CRYPTO_ARENA_SIZE
+#define HYPERCORE_CRYPTO_ARENA_SIZE (64 * 1024)
+#endif
+
+/**
+ * A bump allocator for short lived buffers such as hash outputs, tree
+ * scratch and proofs. Freed 32 and 64 byte library objects, which are
+ * `HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES` larger when they reach the
+ * arena, are kept on recycle lists and reused before the arena grows.
+ * Requests that do not fit fall back to `malloc()`. An arena is used by
+ * one thread at a time.
+ */
+struct hypercore_crypto_arena {
+  unsigned char *bytes;
+  unsigned long int size;
+  unsigned long int offset;
+  unsigned long int fallbacks;
+  void *recycle[2];
+  int owned;
+  hypercore_crypto_allocator_t allocator;
+};
+
+/**
+ * Initializes an arena over `size` bytes of `memory`, or over a new
+ * `malloc()` block if `memory` is `0`. A `size` of `0` selects
+ * `HYPERCORE_CRYPTO_ARENA_SIZE`.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_arena_init(
+  hypercore_crypto_arena_t *arena,
+  void *memory,
+  unsigned long int size);
+
+/**
+ * Releases memory owned by the arena.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_arena_destroy(hypercore_crypto_arena_t *arena);
+
+HYPERCORE_CRYPTO_EXPORT void *
+hypercore_crypto_arena_alloc(hypercore_crypto_arena_t *arena, unsigned long int size);
+
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_arena_free(hypercore_crypto_arena_t *arena, void *ptr);
+
+/**
+ * Returns the current position of the arena for a later
+ * `hypercore_crypto_arena_reset()`.
+ */
+HYPERCORE_CRYPTO_EXPORT unsigned long int
+hypercore_crypto_arena_mark(const hypercore_crypto_arena_t *arena);
+
+/**
+ * Releases everything allocated from the arena after `mark` at once.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_arena_reset(hypercore_crypto_arena_t *arena, unsigned long int mark);
+
+/**
+ * Makes the arena serve library allocations on the calling thread, see
+ * `hypercore_crypto_allocator_push()`.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_arena_install(hypercore_crypto_arena_t *arena);
+
+/**
+ * Ends the scope started by `hypercore_crypto_arena_install()`.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_arena_uninstall(hypercore_crypto_arena_t *arena);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
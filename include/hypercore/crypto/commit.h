@@ -0,0 +1,90 @@
+#ifndef HYPERCORE_CRYPTO_COMMIT_H
+#define HYPERCORE_CRYPTO_COMMIT_H
+
+#include "platform.h"
+#include "tree.h"
+#include "types.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct hypercore_crypto_commit hypercore_crypto_commit_t;
+typedef struct hypercore_crypto_commit_options hypercore_crypto_commit_options_t;
+
+#define HYPERCORE_CRYPTO_COMMIT_DEFAULT_OPTIONS \
+  ((hypercore_crypto_commit_options_t) { 0 })
+
+struct hypercore_crypto_commit_options {
+  // sign once this many blocks are unsigned, `0` signs every block
+  unsigned long long blocks;
+  // sign once the oldest unsigned block is this old, `0` disables it
+  unsigned long long microseconds;
+};
+
+/**
+ * Decides when the roots of an append only log are signed. Appends are
+ * signed at most every `blocks` blocks or `microseconds` after the first
+ * unsigned append, whichever comes first, and always on flush. The
+ * secret key is borrowed and must outlive the commit.
+ */
+struct hypercore_crypto_commit {
+  hypercore_crypto_tree_hash_t tree;
+  const hypercore_crypto_buffer_t *secret_key;
+  unsigned long long blocks;
+  unsigned long long microseconds;
+  // blocks appended and blocks covered by the last signature
+  unsigned long long length;
+  unsigned long long signed_length;
+  // monotonic time in nanoseconds of the oldest unsigned append
+  unsigned long long pending_since;
+};
+
+/**
+ * Initializes a commit for an empty log signed with `secret_key`.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_commit_init(
+  hypercore_crypto_commit_t *commit,
+  const hypercore_crypto_buffer_t *secret_key,
+  hypercore_crypto_commit_options_t options);
+
+/**
+ * Appends the `count` nodes `merkle_next()` returned for one block. Returns
+ * `1` and writes `signature` and the log `length` it covers when the
+ * block is due to be signed, `0` if signing was deferred and below `0`
+ * on error.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_commit_append(
+  hypercore_crypto_commit_t *commit,
+  const hypercore_crypto_node_t **nodes,
+  unsigned long long count,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length);
+
+/**
+ * Signs unsigned blocks older than `microseconds` without appending,
+ * for writers that go idle. Returns like `hypercore_crypto_commit_append()`.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_commit_poll(
+  hypercore_crypto_commit_t *commit,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length);
+
+/**
+ * Signs any unsigned blocks. Returns `1` with `signature` and `length`
+ * written, `0` if every block is already signed and below `0` on error.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_commit_flush(
+  hypercore_crypto_commit_t *commit,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
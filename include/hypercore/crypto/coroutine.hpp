@@ -0,0 +1,259 @@
+#ifndef HYPERCORE_CRYPTO_COROUTINE_HPP
+#define HYPERCORE_CRYPTO_COROUTINE_HPP
+
+#include <array>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "crypto.h"
+
+namespace hypercore::crypto {
+
+/**
+ * An executor resumes a coroutine handle on the thread or loop it
+ * represents. Completions are handed to the executor that issued the
+ * operation. Every operation takes its executor explicitly, as there is
+ * no safe default: a coroutine resumed on a worker thread must never
+ * destroy the `worker_pool` that thread belongs to, because
+ * `hypercore_crypto_jobs_destroy()` would then join the calling thread.
+ */
+template <typename T>
+concept executor = std::copy_constructible<T> &&
+  requires (T executor, std::coroutine_handle<> handle) {
+    executor.post(handle);
+  };
+
+/**
+ * Resumes the coroutine directly on the worker thread that finished the
+ * job, not on the thread that awaited it, so everything after the
+ * `co_await` runs on a pool thread until the coroutine suspends again.
+ * Only use it when that code cannot end up destroying the pool; pass an
+ * executor that posts to the caller's own loop otherwise.
+ */
+struct inline_executor {
+  void post(std::coroutine_handle<> handle) const { handle.resume(); }
+};
+
+/**
+ * Owns a `hypercore_crypto_jobs_t` worker pool.
+ */
+class worker_pool {
+public:
+  explicit worker_pool(unsigned long int threads = 0) {
+    rc_ = hypercore_crypto_jobs_init(&jobs_, { .threads = threads });
+  }
+
+  ~worker_pool() { hypercore_crypto_jobs_destroy(&jobs_); }
+
+  worker_pool(const worker_pool &) = delete;
+  worker_pool &operator=(const worker_pool &) = delete;
+
+  int status() const noexcept { return rc_; }
+  hypercore_crypto_jobs_t *get() noexcept { return &jobs_; }
+
+private:
+  hypercore_crypto_jobs_t jobs_ = {};
+  int rc_ = 0;
+};
+
+/**
+ * Awaits a single job on a worker pool. The awaitable, the job and the C
+ * buffers it points to live in the awaiting coroutine frame, so no
+ * operation allocates. `co_await` yields the return code of the
+ * underlying synchronous function.
+ */
+template <executor Executor>
+class job_awaitable {
+public:
+  job_awaitable(worker_pool &pool, Executor executor) noexcept
+    : jobs_(pool.get()), executor_(executor) {}
+
+  job_awaitable(const job_awaitable &) = delete;
+  job_awaitable &operator=(const job_awaitable &) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) noexcept {
+    hypercore_crypto_job_t *list[] = { &job_ };
+
+    handle_ = handle;
+    job_.callback = complete;
+    job_.data = this;
+
+    int rc = hypercore_crypto_jobs_submit(jobs_, list, 1);
+
+    if (0 != rc) {
+      job_.rc = rc;
+      return false;
+    }
+
+    return true;
+  }
+
+  int await_resume() const noexcept { return job_.rc; }
+
+protected:
+  static hypercore_crypto_buffer_t
+  buffer(std::span<const std::byte> bytes) noexcept {
+    return {
+      bytes.size(),
+      reinterpret_cast<unsigned char *>(const_cast<std::byte *>(bytes.data()))
+    };
+  }
+
+  hypercore_crypto_jobs_t *jobs_;
+  Executor executor_;
+  std::coroutine_handle<> handle_;
+  hypercore_crypto_job_t job_ = {};
+  hypercore_crypto_buffer_t out_ = {};
+  hypercore_crypto_buffer_t message_ = {};
+  hypercore_crypto_buffer_t key_ = {};
+
+private:
+  static void complete(hypercore_crypto_job_t *job) {
+    auto *self = static_cast<job_awaitable *>(job->data);
+
+    // the awaitable may be destroyed as soon as the coroutine resumes
+    Executor executor = self->executor_;
+    std::coroutine_handle<> handle = self->handle_;
+    executor.post(handle);
+  }
+};
+
+template <executor Executor>
+class verify_awaitable : public job_awaitable<Executor> {
+public:
+  verify_awaitable(
+    worker_pool &pool,
+    Executor executor,
+    std::span<const std::byte> signature,
+    std::span<const std::byte> message,
+    std::span<const std::byte> public_key
+  ) noexcept : job_awaitable<Executor>(pool, executor) {
+    this->out_ = this->buffer(signature);
+    this->message_ = this->buffer(message);
+    this->key_ = this->buffer(public_key);
+    this->job_.type = HYPERCORE_CRYPTO_JOB_VERIFY;
+    this->job_.out = &this->out_;
+    this->job_.message = &this->message_;
+    this->job_.key = &this->key_;
+  }
+};
+
+template <executor Executor>
+class data_awaitable : public job_awaitable<Executor> {
+public:
+  data_awaitable(
+    worker_pool &pool,
+    Executor executor,
+    std::array<std::uint8_t, hypercore_crypto_data_BYTES> &out,
+    std::span<const std::byte> data
+  ) noexcept : job_awaitable<Executor>(pool, executor) {
+    this->out_ = { out.size(), out.data() };
+    this->message_ = this->buffer(data);
+    this->job_.type = HYPERCORE_CRYPTO_JOB_DATA;
+    this->job_.out = &this->out_;
+    this->job_.message = &this->message_;
+  }
+};
+
+template <executor Executor>
+class parent_awaitable : public job_awaitable<Executor> {
+public:
+  parent_awaitable(
+    worker_pool &pool,
+    Executor executor,
+    std::array<std::uint8_t, hypercore_crypto_data_BYTES> &out,
+    const hypercore_crypto_node_t &left,
+    const hypercore_crypto_node_t &right
+  ) noexcept : job_awaitable<Executor>(pool, executor) {
+    this->out_ = { out.size(), out.data() };
+    this->job_.type = HYPERCORE_CRYPTO_JOB_PARENT;
+    this->job_.out = &this->out_;
+    this->job_.left = &left;
+    this->job_.right = &right;
+  }
+};
+
+template <executor Executor>
+class tree_awaitable : public job_awaitable<Executor> {
+public:
+  tree_awaitable(
+    worker_pool &pool,
+    Executor executor,
+    std::array<std::uint8_t, hypercore_crypto_data_BYTES> &out,
+    std::span<const hypercore_crypto_node_t *> roots
+  ) noexcept : job_awaitable<Executor>(pool, executor) {
+    this->out_ = { out.size(), out.data() };
+    this->job_.type = HYPERCORE_CRYPTO_JOB_TREE;
+    this->job_.out = &this->out_;
+    this->job_.roots = roots.data();
+    this->job_.count = roots.size();
+  }
+};
+
+/**
+ * `co_await verify(...)` yields `0` for a valid signature. The coroutine
+ * resumes through `executor`.
+ */
+template <executor Executor>
+verify_awaitable<Executor>
+verify(
+  worker_pool &pool,
+  std::span<const std::byte> signature,
+  std::span<const std::byte> message,
+  std::span<const std::byte> public_key,
+  Executor executor
+) noexcept {
+  return { pool, executor, signature, message, public_key };
+}
+
+/**
+ * `co_await data(...)` writes the leaf hash of `data` into `out`.
+ */
+template <executor Executor>
+data_awaitable<Executor>
+data(
+  worker_pool &pool,
+  std::array<std::uint8_t, hypercore_crypto_data_BYTES> &out,
+  std::span<const std::byte> data,
+  Executor executor
+) noexcept {
+  return { pool, executor, out, data };
+}
+
+/**
+ * `co_await parent(...)` writes the parent hash of two nodes into `out`.
+ */
+template <executor Executor>
+parent_awaitable<Executor>
+parent(
+  worker_pool &pool,
+  std::array<std::uint8_t, hypercore_crypto_data_BYTES> &out,
+  const hypercore_crypto_node_t &left,
+  const hypercore_crypto_node_t &right,
+  Executor executor
+) noexcept {
+  return { pool, executor, out, left, right };
+}
+
+/**
+ * `co_await tree(...)` writes the tree hash of `roots` into `out`.
+ */
+template <executor Executor>
+tree_awaitable<Executor>
+tree(
+  worker_pool &pool,
+  std::array<std::uint8_t, hypercore_crypto_data_BYTES> &out,
+  std::span<const hypercore_crypto_node_t *> roots,
+  Executor executor
+) noexcept {
+  return { pool, executor, out, roots };
+}
+
+} // namespace hypercore::crypto
+
+#endif
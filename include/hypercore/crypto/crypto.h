@@ -2,18 +2,62 @@
 #define HYPERCORE_CRYPTO_H
 
 #include "allocator.h"
+#include "arena.h"
+#include "commit.h"
+#include "jobs.h"
+#include "keyring.h"
+#include "metrics.h"
 #include "platform.h"
+#include "pool.h"
+#include "proof.h"
+#include "tree.h"
 #include "version.h"
 #include "types.h"
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Generates a keypair, from `seed` if given. Unset buffers are
+ * allocated: the public key with `hypercore_crypto_alloc()` and the
+ * secret key with `sodium_malloc()`, so key material is never served by
+ * an allocator scope.
+ */
 HYPERCORE_CRYPTO_EXPORT int
 hypercore_crypto_keypair(
   hypercore_crypto_keypair_t *keypair,
   const unsigned char *seed);
 
+/**
+ * Releases keypair buffers allocated by the library. The secret key is
+ * released with `sodium_free()`, so a caller supplied secret key must
+ * come from `sodium_malloc()` if it is released here.
+ */
 HYPERCORE_CRYPTO_EXPORT void
 hypercore_crypto_keypair_destroy(hypercore_crypto_keypair_t *keypair);
 
+/**
+ * Derives `count` keypairs from a 32 byte `master` seed where the seed of
+ * each keypair is `blake2b(key=master, "hypercore" || names[i])`. Public
+ * and secret keys are placed in two shared regions that must be released
+ * with `hypercore_crypto_keypair_destroy_many()`. The secret key region
+ * comes from `sodium_malloc()` like in `hypercore_crypto_keypair()`. An empty batch succeeds
+ * without allocating and a `count` whose key regions would overflow fails
+ * with `-ERANGE`.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_keypair_derive_many(
+  const unsigned char *master,
+  const hypercore_crypto_buffer_t *names,
+  unsigned long long count,
+  hypercore_crypto_keypair_t *keypairs);
+
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_keypair_destroy_many(
+  hypercore_crypto_keypair_t *keypairs,
+  unsigned long long count);
+
 HYPERCORE_CRYPTO_EXPORT int
 hypercore_crypto_sign(
   hypercore_crypto_buffer_t *out,
@@ -48,12 +92,67 @@ hypercore_crypto_tree(
   const hypercore_crypto_node_t **roots,
   unsigned long long count);
 
+/**
+ * Signs the `hypercore_crypto_tree()` hash of `roots` with `secret_key`
+ * into `signature`. The hash stays on the stack, so nothing is allocated
+ * when `signature->bytes` is given.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_sign_roots(
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count,
+  const hypercore_crypto_buffer_t *secret_key);
+
+/**
+ * Verifies block `index` in one call. Hashes `block` and its `siblings`,
+ * ordered from the leaf up, until it reaches one of `roots`, then checks
+ * `signature` over the `hypercore_crypto_tree()` hash of `roots`. Every
+ * intermediate hash stays on the stack. Returns `0` if the block is
+ * signed by `public_key`.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_verify_block(
+  const hypercore_crypto_buffer_t *block,
+  unsigned long long index,
+  const hypercore_crypto_node_t **siblings,
+  unsigned long long siblings_count,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long roots_count,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *public_key);
+
 HYPERCORE_CRYPTO_EXPORT int
 hypercore_crypto_randombytes(hypercore_crypto_buffer_t *out);
 
+/**
+ * Enables or disables serving small `hypercore_crypto_randombytes()`
+ * requests from a per-thread ChaCha20 keystream buffer that is seeded
+ * from `randombytes_buf()` and reseeded periodically and after `fork()`.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_randombytes_pool_set(int enable);
+
 HYPERCORE_CRYPTO_EXPORT int
 hypercore_crypto_discoverykey(
   hypercore_crypto_buffer_t *out,
   hypercore_crypto_buffer_t *tree);
 
+/**
+ * Computes discovery keys for `count` public keys into `out` as a
+ * contiguous array of `crypto_generichash_BYTES` sized hashes.
+ * `out->bytes` is allocated once if not given. On success `out->size`
+ * is the number of bytes written. An empty batch returns `0` and
+ * leaves `out` untouched.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_discoverykey_many(
+  hypercore_crypto_buffer_t *out,
+  const hypercore_crypto_buffer_t *keys,
+  unsigned long long count);
+
+#if defined(__cplusplus)
+}
+#endif
+
 #endif
@@ -0,0 +1,145 @@
+#ifndef HYPERCORE_CRYPTO_JOBS_H
+#define HYPERCORE_CRYPTO_JOBS_H
+
+#include <pthread.h>
+
+#include "platform.h"
+#include "types.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct hypercore_crypto_job hypercore_crypto_job_t;
+typedef struct hypercore_crypto_jobs hypercore_crypto_jobs_t;
+typedef struct hypercore_crypto_jobs_options hypercore_crypto_jobs_options_t;
+typedef struct hypercore_crypto_jobs_queue hypercore_crypto_jobs_queue_t;
+
+typedef void (hypercore_crypto_job_callback_t)(hypercore_crypto_job_t *job);
+
+#ifndef HYPERCORE_CRYPTO_JOBS_THREADS
+#define HYPERCORE_CRYPTO_JOBS_THREADS 4
+#endif
+
+// jobs a worker takes from a queue at once
+#ifndef HYPERCORE_CRYPTO_JOBS_BATCH
+#define HYPERCORE_CRYPTO_JOBS_BATCH 16
+#endif
+
+#define HYPERCORE_CRYPTO_JOBS_DEFAULT_OPTIONS \
+  ((hypercore_crypto_jobs_options_t) { 0 })
+
+enum hypercore_crypto_job_type {
+  HYPERCORE_CRYPTO_JOB_DATA = 0,
+  HYPERCORE_CRYPTO_JOB_PARENT = 1,
+  HYPERCORE_CRYPTO_JOB_TREE = 2,
+  HYPERCORE_CRYPTO_JOB_SIGN = 3,
+  HYPERCORE_CRYPTO_JOB_VERIFY = 4,
+  HYPERCORE_CRYPTO_JOB_MAX_ENUM = HYPERCORE_CRYPTO_MAX_ENUM
+};
+
+struct hypercore_crypto_jobs_options {
+  // worker threads, defaults to `HYPERCORE_CRYPTO_JOBS_THREADS`
+  unsigned long int threads;
+};
+
+/**
+ * A caller owned unit of work. The fields used by each type mirror the
+ * arguments of the synchronous function:
+ *
+ *   DATA    `out`, `message`
+ *   PARENT  `out`, `left`, `right`
+ *   TREE    `out`, `roots`, `count`
+ *   SIGN    `out`, `message`, `key` (secret key)
+ *   VERIFY  `out` (signature), `message`, `key` (public key)
+ *
+ * `rc` holds the return code of the function once the job completes.
+ * Jobs with a `callback` are completed by calling it on the worker
+ * thread, all others are placed on the completion queue.
+ */
+struct hypercore_crypto_job {
+  enum hypercore_crypto_job_type type;
+  int rc;
+  hypercore_crypto_buffer_t *out;
+  const hypercore_crypto_buffer_t *message;
+  const hypercore_crypto_buffer_t *key;
+  const hypercore_crypto_node_t *left;
+  const hypercore_crypto_node_t *right;
+  const hypercore_crypto_node_t **roots;
+  unsigned long long count;
+  hypercore_crypto_job_callback_t *callback;
+  void *data;
+  hypercore_crypto_job_t *next;
+};
+
+/**
+ * A fixed size pool of worker threads. Each worker owns a queue and
+ * steals from the others when its own queue is empty.
+ */
+struct hypercore_crypto_jobs {
+  unsigned long int length;
+  unsigned long int next;
+  unsigned long int pending;
+  // bumped by every submission, so idle workers know when to look again
+  unsigned long int generation;
+  int running;
+  int fds[2];
+  hypercore_crypto_jobs_queue_t *queues;
+  hypercore_crypto_job_t *completed;
+  hypercore_crypto_job_t *completed_tail;
+  pthread_mutex_t mutex;
+  pthread_mutex_t completed_mutex;
+  pthread_cond_t cond;
+};
+
+/**
+ * Starts the worker threads and creates the completion queue.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_jobs_init(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_jobs_options_t options);
+
+/**
+ * Runs all submitted jobs to completion and stops the worker threads.
+ * Completed jobs that were not polled are dropped.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_jobs_destroy(hypercore_crypto_jobs_t *jobs);
+
+/**
+ * Submits `count` jobs. Jobs must stay valid until they complete.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_jobs_submit(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_job_t **list,
+  unsigned long int count);
+
+/**
+ * Returns a file descriptor that becomes readable when jobs are placed
+ * on the completion queue (an `eventfd` on Linux, a pipe elsewhere).
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_jobs_fd(const hypercore_crypto_jobs_t *jobs);
+
+/**
+ * Moves up to `max` completed jobs into `list` and returns how many.
+ */
+HYPERCORE_CRYPTO_EXPORT unsigned long int
+hypercore_crypto_jobs_poll(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_job_t **list,
+  unsigned long int max);
+
+/**
+ * Runs a job on the calling thread.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_job_run(hypercore_crypto_job_t *job);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef HYPERCORE_CRYPTO_KEYRING_H
+#define HYPERCORE_CRYPTO_KEYRING_H
+
+#include "platform.h"
+#include "types.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct hypercore_crypto_keyring hypercore_crypto_keyring_t;
+typedef struct hypercore_crypto_keyring_options hypercore_crypto_keyring_options_t;
+
+// size of a keyring slot (an ed25519 secret key)
+#define HYPERCORE_CRYPTO_KEYRING_SLOT_BYTES 64
+
+#ifndef HYPERCORE_CRYPTO_KEYRING_REGION_SLOTS
+#define HYPERCORE_CRYPTO_KEYRING_REGION_SLOTS 1024
+#endif
+
+#define HYPERCORE_CRYPTO_KEYRING_DEFAULT_OPTIONS \
+  ((hypercore_crypto_keyring_options_t) { 0 })
+
+enum hypercore_crypto_keyring_protection {
+  HYPERCORE_CRYPTO_KEYRING_NOACCESS = 0,
+  HYPERCORE_CRYPTO_KEYRING_READONLY = 1,
+  HYPERCORE_CRYPTO_KEYRING_READWRITE = 2,
+  HYPERCORE_CRYPTO_KEYRING_MAX_ENUM = HYPERCORE_CRYPTO_MAX_ENUM
+};
+
+struct hypercore_crypto_keyring_options {
+  // slots per region, defaults to `HYPERCORE_CRYPTO_KEYRING_REGION_SLOTS`
+  unsigned long int region_slots;
+};
+
+/**
+ * A keyring stores secret keys in fixed size slots inside a few large
+ * `sodium_malloc()` regions so many keys share guard pages and locked
+ * memory. Slots are allocated and freed in constant time.
+ */
+struct hypercore_crypto_keyring {
+  unsigned long int region_slots;
+  unsigned long int length;
+  unsigned long int capacity;
+  unsigned char **regions;
+  unsigned long int *free;
+  unsigned long int free_length;
+  // one bit per slot, set while the slot is handed out
+  unsigned char *allocated;
+};
+
+/**
+ * Initializes a keyring. No region is allocated until the first slot is.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_keyring_init(
+  hypercore_crypto_keyring_t *keyring,
+  hypercore_crypto_keyring_options_t options);
+
+/**
+ * Zeroes and releases all regions owned by the keyring.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_keyring_destroy(hypercore_crypto_keyring_t *keyring);
+
+/**
+ * Allocates a slot and points `secret_key` at it. Returns the slot
+ * number or a negative error code.
+ */
+HYPERCORE_CRYPTO_EXPORT long int
+hypercore_crypto_keyring_alloc(
+  hypercore_crypto_keyring_t *keyring,
+  hypercore_crypto_buffer_t *secret_key);
+
+/**
+ * Zeroes `slot` and returns it to the keyring. Fails with `-EINVAL` if
+ * `slot` is not currently allocated.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_keyring_free(
+  hypercore_crypto_keyring_t *keyring,
+  long int slot);
+
+/**
+ * Returns a pointer to the bytes of `slot` or `0`.
+ */
+HYPERCORE_CRYPTO_EXPORT unsigned char *
+hypercore_crypto_keyring_slot(
+  const hypercore_crypto_keyring_t *keyring,
+  long int slot);
+
+/**
+ * Generates a keypair like `hypercore_crypto_keypair()` with the secret
+ * key stored in a new keyring slot. Returns the slot number or a
+ * negative error code.
+ */
+HYPERCORE_CRYPTO_EXPORT long int
+hypercore_crypto_keyring_keypair(
+  hypercore_crypto_keyring_t *keyring,
+  hypercore_crypto_keypair_t *keypair,
+  const unsigned char *seed);
+
+/**
+ * Changes the protection of the region holding `slot` with
+ * `sodium_mprotect_*()`, or of every region if `slot` is negative.
+ * Regions must be writable to allocate, free, or generate keys.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_keyring_protect(
+  hypercore_crypto_keyring_t *keyring,
+  long int slot,
+  enum hypercore_crypto_keyring_protection protection);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
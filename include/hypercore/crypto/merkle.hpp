@@ -0,0 +1,181 @@
+#ifndef HYPERCORE_CRYPTO_MERKLE_HPP
+#define HYPERCORE_CRYPTO_MERKLE_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <sodium.h>
+
+#include "crypto.h"
+
+namespace hypercore::crypto {
+
+/**
+ * Flat tree index math evaluated at compile time where possible.
+ * See `deps/flat-tree` for the runtime C implementation.
+ */
+namespace flat_tree {
+
+constexpr std::uint64_t
+depth(std::uint64_t index) noexcept {
+  return std::countr_one(index);
+}
+
+constexpr std::uint64_t
+offset(std::uint64_t index) noexcept {
+  return index >> (depth(index) + 1);
+}
+
+constexpr std::uint64_t
+index(std::uint64_t depth, std::uint64_t offset) noexcept {
+  return (offset << (depth + 1)) | ((std::uint64_t(1) << depth) - 1);
+}
+
+constexpr std::uint64_t
+parent(std::uint64_t index) noexcept {
+  return flat_tree::index(depth(index) + 1, offset(index) >> 1);
+}
+
+constexpr std::uint64_t
+sibling(std::uint64_t index) noexcept {
+  return flat_tree::index(depth(index), offset(index) ^ 1);
+}
+
+static_assert(parent(0) == 1 && parent(2) == 1 && parent(1) == 3);
+static_assert(parent(5) == 3 && sibling(4) == 6 && sibling(3) == 11);
+
+} // namespace flat_tree
+
+template <std::size_t DigestSize>
+struct merkle_node {
+  std::uint64_t index = 0;
+  std::uint64_t parent = 0;
+  std::uint64_t size = 0;
+  std::array<std::uint8_t, DigestSize> hash = {};
+};
+
+/**
+ * Hypercore node hashing: BLAKE2b-256 over a type byte, the big endian
+ * byte length, and the data or child hashes. Identical to
+ * `hypercore_crypto_data()` and `hypercore_crypto_parent()` but inlined
+ * into the builder. Any type with the same `digest_size`, `node`,
+ * `leaf()` and `parent()` members can be used as a policy instead.
+ */
+struct blake2b_policy {
+  static constexpr std::size_t digest_size = hypercore_crypto_data_BYTES;
+  using node = merkle_node<digest_size>;
+
+  static void
+  leaf(node &out, std::span<const std::byte> data) noexcept {
+    crypto_generichash_state state;
+    std::uint8_t header[9] = { HYPERCORE_CRYPTO_LEAF_BYTE };
+
+    encode(header + 1, data.size());
+    crypto_generichash_init(&state, nullptr, 0, digest_size);
+    crypto_generichash_update(&state, header, sizeof(header));
+    crypto_generichash_update(
+      &state,
+      reinterpret_cast<const unsigned char *>(data.data()),
+      data.size());
+    crypto_generichash_final(&state, out.hash.data(), digest_size);
+  }
+
+  static void
+  parent(node &out, const node &left, const node &right) noexcept {
+    crypto_generichash_state state;
+    std::uint8_t header[9] = { HYPERCORE_CRYPTO_PARENT_BYTE };
+
+    encode(header + 1, left.size + right.size);
+    crypto_generichash_init(&state, nullptr, 0, digest_size);
+    crypto_generichash_update(&state, header, sizeof(header));
+    crypto_generichash_update(&state, left.hash.data(), digest_size);
+    crypto_generichash_update(&state, right.hash.data(), digest_size);
+    crypto_generichash_final(&state, out.hash.data(), digest_size);
+  }
+
+private:
+  static constexpr void
+  encode(std::uint8_t *out, std::uint64_t value) noexcept {
+    for (int i = 7; i >= 0; --i, value >>= 8) {
+      out[i] = static_cast<std::uint8_t>(value);
+    }
+  }
+};
+
+/**
+ * Re-implements `merkle_next()` with the hash policy and digest size as
+ * compile time parameters. Roots live in a fixed array and nodes are
+ * plain values, so appending a block never allocates besides growing
+ * the caller's output vector.
+ */
+template <
+  typename HashPolicy,
+  typename Allocator = std::allocator<typename HashPolicy::node>
+>
+class merkle_builder {
+public:
+  using node = typename HashPolicy::node;
+  using node_list = std::vector<node, Allocator>;
+
+  // a tree over 64 bit indices never has more roots than this
+  static constexpr std::size_t max_roots = 64;
+
+  /**
+   * Appends a block and adds the new leaf and every parent it completes
+   * to `nodes`, in the order `merkle_next()` returns them.
+   */
+  void
+  next(std::span<const std::byte> data, node_list &nodes) {
+    node leaf;
+    leaf.index = 2 * blocks_++;
+    leaf.parent = flat_tree::parent(leaf.index);
+    leaf.size = data.size();
+    HashPolicy::leaf(leaf, data);
+
+    nodes.push_back(leaf);
+    roots_[length_++] = leaf;
+
+    while (length_ > 1) {
+      const node &left = roots_[length_ - 2];
+      const node &right = roots_[length_ - 1];
+
+      if (left.parent != right.parent) {
+        break;
+      }
+
+      node parent;
+      parent.index = left.parent;
+      parent.parent = flat_tree::parent(left.parent);
+      parent.size = left.size + right.size;
+      HashPolicy::parent(parent, left, right);
+
+      nodes.push_back(parent);
+      roots_[length_ - 2] = parent;
+      --length_;
+    }
+  }
+
+  std::span<const node>
+  roots() const noexcept {
+    return { roots_.data(), length_ };
+  }
+
+  std::uint64_t
+  blocks() const noexcept {
+    return blocks_;
+  }
+
+private:
+  std::array<node, max_roots> roots_ = {};
+  std::size_t length_ = 0;
+  std::uint64_t blocks_ = 0;
+};
+
+} // namespace hypercore::crypto
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef HYPERCORE_CRYPTO_METRICS_H
+#define HYPERCORE_CRYPTO_METRICS_H
+
+#include "platform.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Forward declarations
+struct hypercore_crypto_metrics;
+struct hypercore_crypto_metrics_counter;
+
+typedef struct hypercore_crypto_metrics hypercore_crypto_metrics_t;
+typedef struct hypercore_crypto_metrics_counter hypercore_crypto_metrics_counter_t;
+
+/**
+ * Latency histogram buckets. Values below 8 nanoseconds get a bucket
+ * each, above that every power of two is split into 8 buckets, so a
+ * bucket is at most 12.5% wide. The last bucket holds everything from
+ * about 16 seconds up.
+ */
+#define HYPERCORE_CRYPTO_METRICS_BUCKETS 256
+
+/**
+ * Instrumented operations.
+ */
+typedef enum hypercore_crypto_metrics_op {
+  HYPERCORE_CRYPTO_METRICS_KEYPAIR = 0,
+  HYPERCORE_CRYPTO_METRICS_SIGN,
+  HYPERCORE_CRYPTO_METRICS_VERIFY,
+  HYPERCORE_CRYPTO_METRICS_DATA,
+  HYPERCORE_CRYPTO_METRICS_PARENT,
+  HYPERCORE_CRYPTO_METRICS_TREE,
+  HYPERCORE_CRYPTO_METRICS_DISCOVERYKEY,
+  // `hypercore_crypto_sign_roots()` and `hypercore_crypto_tree_hash_sign()`
+  HYPERCORE_CRYPTO_METRICS_SIGN_ROOTS,
+  HYPERCORE_CRYPTO_METRICS_VERIFY_BLOCK,
+  HYPERCORE_CRYPTO_METRICS_OPS
+} hypercore_crypto_metrics_op_t;
+
+/**
+ * Counters of one operation. `bytes` is the input length the operation
+ * hashed or signed and `failures` the calls that returned below `0`.
+ */
+struct hypercore_crypto_metrics_counter {
+  unsigned long long calls;
+  unsigned long long failures;
+  unsigned long long bytes;
+  unsigned long long nanoseconds;
+  unsigned long long histogram[HYPERCORE_CRYPTO_METRICS_BUCKETS];
+};
+
+struct hypercore_crypto_metrics {
+  hypercore_crypto_metrics_counter_t ops[HYPERCORE_CRYPTO_METRICS_OPS];
+};
+
+/**
+ * Sums the counters of every thread into `metrics`. Collection is only
+ * compiled in with `HYPERCORE_CRYPTO_METRICS` defined (`./configure
+ * --metrics`), otherwise `metrics` is zeroed and `-ENOTSUP` returned.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_metrics_snapshot(hypercore_crypto_metrics_t *metrics);
+
+/**
+ * Returns the histogram bucket a latency of `value` nanoseconds is
+ * counted in.
+ */
+HYPERCORE_CRYPTO_EXPORT unsigned long int
+hypercore_crypto_metrics_bucket_index(unsigned long long value);
+
+/**
+ * Returns the largest value in nanoseconds recorded in histogram
+ * bucket `index`.
+ */
+HYPERCORE_CRYPTO_EXPORT unsigned long long
+hypercore_crypto_metrics_bucket(unsigned long int index);
+
+/**
+ * Returns the latency in nanoseconds at or below which `quantile`
+ * (`0.0` to `1.0`) of the calls counted in `counter` completed.
+ */
+HYPERCORE_CRYPTO_EXPORT unsigned long long
+hypercore_crypto_metrics_percentile(
+  const hypercore_crypto_metrics_counter_t *counter,
+  double quantile);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -11,6 +11,14 @@
 #  define HYPERCORE_CRYPTO_INLINE
 #endif
 
+#ifndef HYPERCORE_CRYPTO_THREAD_LOCAL
+#  if defined(_MSC_VER)
+#    define HYPERCORE_CRYPTO_THREAD_LOCAL __declspec(thread)
+#  else
+#    define HYPERCORE_CRYPTO_THREAD_LOCAL __thread
+#  endif
+#endif
+
 #ifndef HYPERCORE_CRYPTO_ALIGNMENT
 #  define HYPERCORE_CRYPTO_ALIGNMENT sizeof(unsigned long) // platform word
 #endif
@@ -0,0 +1,75 @@
+#ifndef HYPERCORE_CRYPTO_POOL_H
+#define HYPERCORE_CRYPTO_POOL_H
+
+#include <pthread.h>
+
+#include "platform.h"
+#include "types.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct hypercore_crypto_keypair_pool hypercore_crypto_keypair_pool_t;
+typedef struct hypercore_crypto_keypair_pool_options hypercore_crypto_keypair_pool_options_t;
+
+#ifndef HYPERCORE_CRYPTO_KEYPAIR_POOL_CAPACITY
+#define HYPERCORE_CRYPTO_KEYPAIR_POOL_CAPACITY 64
+#endif
+
+#define HYPERCORE_CRYPTO_KEYPAIR_POOL_DEFAULT_OPTIONS \
+  ((hypercore_crypto_keypair_pool_options_t) { 0 })
+
+struct hypercore_crypto_keypair_pool_options {
+  // keypairs held by the pool, defaults to `HYPERCORE_CRYPTO_KEYPAIR_POOL_CAPACITY`
+  unsigned long int capacity;
+  // refill starts when at most this many keypairs are ready, `0` or a
+  // value not below `capacity` selects the default of `capacity / 2`
+  unsigned long int watermark;
+};
+
+/**
+ * A ring of pre-generated keypairs kept in one `sodium_malloc()` region
+ * and refilled by a background thread.
+ */
+struct hypercore_crypto_keypair_pool {
+  unsigned char *keys;
+  unsigned long int capacity;
+  unsigned long int watermark;
+  unsigned long int head;
+  unsigned long int length;
+  int running;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t refill;
+};
+
+/**
+ * Allocates the pool and starts its refill thread.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_keypair_pool_init(
+  hypercore_crypto_keypair_pool_t *pool,
+  hypercore_crypto_keypair_pool_options_t options);
+
+/**
+ * Stops the refill thread and zeroes and releases the pool memory.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_keypair_pool_destroy(hypercore_crypto_keypair_pool_t *pool);
+
+/**
+ * Moves a ready keypair into `keypair`, allocating its buffers like
+ * `hypercore_crypto_keypair()` if they are not set. Falls back to
+ * generating one on the calling thread if the pool is empty.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_keypair_pool_pop(
+  hypercore_crypto_keypair_pool_t *pool,
+  hypercore_crypto_keypair_t *keypair);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef HYPERCORE_CRYPTO_PROOF_H
+#define HYPERCORE_CRYPTO_PROOF_H
+
+#include "platform.h"
+#include "types.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// largest number of nodes `hypercore_crypto_proof_verify()` holds while
+// hashing up to a root, one pending node per tree level
+#define HYPERCORE_CRYPTO_PROOF_MAX_DEPTH 64
+
+/**
+ * Writes the flat tree indices of the nodes needed to prove the blocks in
+ * `ranges` of a tree of `length` blocks into `indices`, in ascending
+ * order. `ranges` holds `count` pairs of a first and an end (exclusive)
+ * block, sorted and not overlapping. A node is only included if no block
+ * of the request is under it, so siblings shared by several blocks or
+ * ranges are included once and nodes that can be hashed from requested
+ * blocks not at all. Roots are not included. Sets `*nodes` to the number
+ * of indices and returns `-ERANGE` if that is more than `*nodes` was.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_proof_nodes(
+  unsigned long long length,
+  const unsigned long long *ranges,
+  unsigned long long count,
+  unsigned long long *indices,
+  unsigned long long *nodes);
+
+/**
+ * Verifies the blocks in `ranges`, given in order as `blocks`, with the
+ * `nodes` `hypercore_crypto_proof_nodes()` selected, in the same order.
+ * Blocks and nodes are hashed up to their roots in one left to right
+ * pass, each pair of siblings as soon as both are known, and every root
+ * reached has to be in `roots`. Returns `0` if the roots are signed by
+ * `public_key` and every block is under one of them.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_proof_verify(
+  const unsigned long long *ranges,
+  unsigned long long count,
+  const hypercore_crypto_buffer_t *blocks,
+  const hypercore_crypto_node_t **nodes,
+  unsigned long long nodes_count,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long roots_count,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *public_key);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
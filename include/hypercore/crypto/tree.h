@@ -0,0 +1,85 @@
+#ifndef HYPERCORE_CRYPTO_TREE_H
+#define HYPERCORE_CRYPTO_TREE_H
+
+#include "platform.h"
+#include "types.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct hypercore_crypto_tree_hash hypercore_crypto_tree_hash_t;
+
+// a tree of at most 2^64 blocks has at most 64 roots
+#define HYPERCORE_CRYPTO_TREE_HASH_MAX_ROOTS 64
+
+// root hash, big endian index and big endian length
+#define HYPERCORE_CRYPTO_TREE_HASH_ROOT_BYTES 48
+
+/**
+ * The input of `hypercore_crypto_tree()` kept encoded across appends.
+ * Roots that do not change keep their encoding, so an append only
+ * encodes the new root and the hash is one pass over `encoded`. Holds
+ * no pointers and can live on the stack or next to a `merkle_t`.
+ */
+struct hypercore_crypto_tree_hash {
+  unsigned long long count;
+  unsigned long long indices[HYPERCORE_CRYPTO_TREE_HASH_MAX_ROOTS];
+  unsigned long long sizes[HYPERCORE_CRYPTO_TREE_HASH_MAX_ROOTS];
+  unsigned char encoded[
+    1 + HYPERCORE_CRYPTO_TREE_HASH_MAX_ROOTS * HYPERCORE_CRYPTO_TREE_HASH_ROOT_BYTES
+  ];
+};
+
+/**
+ * Initializes an empty tree hash.
+ */
+HYPERCORE_CRYPTO_EXPORT void
+hypercore_crypto_tree_hash_init(hypercore_crypto_tree_hash_t *tree);
+
+/**
+ * Appends `node` as a root and drops the roots it covers. Feeding it
+ * every node `merkle_next()` returns, in order, keeps it in step with
+ * the roots of the `merkle_t`.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_tree_hash_append(
+  hypercore_crypto_tree_hash_t *tree,
+  const hypercore_crypto_node_t *node);
+
+/**
+ * Replaces the roots with `roots`, only encoding those after the prefix
+ * whose indices, lengths and hashes are unchanged.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_tree_hash_update(
+  hypercore_crypto_tree_hash_t *tree,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count);
+
+/**
+ * Computes the hash `hypercore_crypto_tree()` computes for the current
+ * roots. Does not allocate when `out->bytes` is given.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_tree_hash_final(
+  const hypercore_crypto_tree_hash_t *tree,
+  hypercore_crypto_buffer_t *out);
+
+/**
+ * Signs the hash `hypercore_crypto_tree_hash_final()` computes with
+ * `secret_key`, the same signature `hypercore_crypto_sign_roots()` makes
+ * for the current roots. Does not allocate when `signature->bytes` is
+ * given.
+ */
+HYPERCORE_CRYPTO_EXPORT int
+hypercore_crypto_tree_hash_sign(
+  const hypercore_crypto_tree_hash_t *tree,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *secret_key);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
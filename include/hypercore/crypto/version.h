@@ -3,6 +3,10 @@
 
 #include "platform.h"
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 /**
  * Returns the version string for the library.
  */
@@ -40,4 +44,8 @@ hypercore_crypto_version_patch();
 HYPERCORE_CRYPTO_EXPORT const unsigned long int
 hypercore_crypto_version_revision();
 
+#if defined(__cplusplus)
+}
+#endif
+
 #endif
@@ -1,5 +1,9 @@
 #include "hypercore/crypto/allocator.h"
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
 
 #ifndef HYPERCORE_CRYPTO_ALLOCATOR_ALLOC
 #define HYPERCORE_CRYPTO_ALLOCATOR_ALLOC 0
@@ -9,27 +13,174 @@
 #define HYPERCORE_CRYPTO_ALLOCATOR_FREE 0
 #endif
 
+// live bytes kept by a thread before they are folded into `live`
+#ifndef HYPERCORE_CRYPTO_ALLOCATOR_STATS_BATCH
+#define HYPERCORE_CRYPTO_ALLOCATOR_STATS_BATCH (64 * 1024)
+#endif
+
+// every block carries its size and the scope that allocated it in
+// front, keeping 16 byte alignment
+#define HEADER_BYTES HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES
+
+struct header {
+  unsigned long int size;
+  hypercore_crypto_allocator_t *scope;
+};
+
 static void *(*alloc)(unsigned long int) = HYPERCORE_CRYPTO_ALLOCATOR_ALLOC;
 static void (*dealloc)(void *) = HYPERCORE_CRYPTO_ALLOCATOR_FREE;
 
-static struct hypercore_crypto_allocator_stats_s stats = { 0 };
+// installed by the library when no allocator was set by the user
+static void *(*default_alloc)(unsigned long int) = 0;
+static void (*default_dealloc)(void *) = 0;
+
+// innermost allocator scope of the calling thread
+static HYPERCORE_CRYPTO_THREAD_LOCAL hypercore_crypto_allocator_t *scope = 0;
+
+/**
+ * Counters owned by one thread. Only the owner writes them, other
+ * threads read them while aggregating, so no write is ever contended.
+ */
+struct shard {
+  unsigned long long alloc;
+  unsigned long long free;
+  long long delta;
+  int registered;
+  struct shard *next;
+};
+
+static HYPERCORE_CRYPTO_THREAD_LOCAL struct shard shard = { 0 };
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static struct shard *shards = 0;
+
+// counts of threads that have exited
+static unsigned long long retired_alloc = 0;
+static unsigned long long retired_free = 0;
+
+// live bytes flushed from the shards and the highest value seen
+static long long live = 0;
+static long long peak = 0;
+
+#define load(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define store(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static void
+flush(struct shard *local) {
+  long long current = __atomic_add_fetch(&live, load(local->delta), __ATOMIC_RELAXED);
+  long long highest = load(peak);
+
+  store(local->delta, 0);
+
+  while (
+    current > highest &&
+    !__atomic_compare_exchange_n(
+      &peak, &highest, current, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+  ) {
+    continue;
+  }
+}
+
+static void
+retire(void *ptr) {
+  struct shard *local = ptr;
+
+  pthread_mutex_lock(&mutex);
+  flush(local);
+  retired_alloc += local->alloc;
+  retired_free += local->free;
+
+  for (struct shard **link = &shards; 0 != *link; link = &(*link)->next) {
+    if (local == *link) {
+      *link = local->next;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&mutex);
+  memset(local, 0, sizeof(*local));
+}
+
+static void
+init() {
+  pthread_key_create(&key, retire);
+}
+
+static struct shard *
+local_shard() {
+  if (0 == shard.registered) {
+    pthread_once(&once, init);
+    pthread_mutex_lock(&mutex);
+    shard.registered = 1;
+    shard.next = shards;
+    shards = &shard;
+    pthread_mutex_unlock(&mutex);
+    pthread_setspecific(key, &shard);
+  }
+
+  return &shard;
+}
+
+static void
+count(long long size) {
+  struct shard *local = local_shard();
+  long long delta = local->delta + size;
+
+  if (size > 0) {
+    store(local->alloc, local->alloc + 1);
+  } else {
+    store(local->free, local->free + 1);
+  }
+
+  store(local->delta, delta);
+
+  if (
+    delta > HYPERCORE_CRYPTO_ALLOCATOR_STATS_BATCH ||
+    delta < -HYPERCORE_CRYPTO_ALLOCATOR_STATS_BATCH
+  ) {
+    flush(local);
+  }
+}
 
 const struct hypercore_crypto_allocator_stats_s
 hypercore_crypto_allocator_stats() {
-  return (struct hypercore_crypto_allocator_stats_s) {
-    .alloc = stats.alloc,
-    .free = stats.free
-  };
+  struct hypercore_crypto_allocator_stats_s stats = { 0 };
+  long long current = 0;
+  long long highest = 0;
+
+  pthread_mutex_lock(&mutex);
+
+  stats.alloc = retired_alloc;
+  stats.free = retired_free;
+  current = load(live);
+  highest = load(peak);
+
+  for (struct shard *local = shards; 0 != local; local = local->next) {
+    stats.alloc += load(local->alloc);
+    stats.free += load(local->free);
+    current += load(local->delta);
+  }
+
+  pthread_mutex_unlock(&mutex);
+
+  // bytes freed on another thread than they were allocated on can make
+  // the sum dip below zero for a moment
+  stats.current = current > 0 ? (unsigned long long) current : 0;
+  stats.peak = highest > current ? highest : stats.current;
+
+  return stats;
 }
 
-int
+unsigned long long
 hypercore_crypto_allocator_alloc_count() {
-  return stats.alloc;
+  return hypercore_crypto_allocator_stats().alloc;
 }
 
-int
+unsigned long long
 hypercore_crypto_allocator_free_count() {
-  return stats.free;
+  return hypercore_crypto_allocator_stats().free;
 }
 
 void
@@ -42,28 +193,105 @@ hypercore_crypto_deallocator_set(void (*deallocator)(void *)) {
   dealloc = deallocator;
 }
 
+void
+hypercore_crypto_allocator_default(
+  void *(*allocator)(unsigned long int),
+  void (*deallocator)(void *)
+) {
+  default_alloc = allocator;
+  default_dealloc = deallocator;
+}
+
+void
+hypercore_crypto_allocator_push(hypercore_crypto_allocator_t *allocator) {
+  if (0 != allocator) {
+    allocator->previous = scope;
+    scope = allocator;
+  }
+}
+
+void
+hypercore_crypto_allocator_pop() {
+  if (0 != scope) {
+    scope = scope->previous;
+  }
+}
+
 void *
 hypercore_crypto_alloc(unsigned long int size) {
-  if (0 == size) {
+  struct header header = { size, scope };
+  unsigned char *bytes = 0;
+
+  if (0 == size || size > (unsigned long int) -1 - HEADER_BYTES) {
     return 0;
+  } else if (0 != scope) {
+    bytes = scope->alloc(scope->ctx, HEADER_BYTES + size);
   } else if (0 != alloc) {
-    (void) stats.alloc++;
-    return alloc(size);
+    bytes = alloc(HEADER_BYTES + size);
+  } else if (0 != default_alloc) {
+    bytes = default_alloc(HEADER_BYTES + size);
   } else {
-    (void) stats.alloc++;
-    return malloc(size);
+    bytes = malloc(HEADER_BYTES + size);
   }
+
+  if (0 == bytes) {
+    return 0;
+  }
+
+  memcpy(bytes, &header, sizeof(header));
+  count((long long) size);
+
+  return bytes + HEADER_BYTES;
+}
+
+void *
+hypercore_crypto_realloc(void *ptr, unsigned long int size) {
+  struct header header = { 0 };
+  unsigned char *bytes = 0;
+
+  if (0 == ptr) {
+    return hypercore_crypto_alloc(size);
+  }
+
+  if (0 == size) {
+    hypercore_crypto_free(ptr);
+    return 0;
+  }
+
+  bytes = hypercore_crypto_alloc(size);
+
+  if (0 == bytes) {
+    return 0;
+  }
+
+  memcpy(&header, (unsigned char *) ptr - HEADER_BYTES, sizeof(header));
+  memcpy(bytes, ptr, header.size < size ? header.size : size);
+  hypercore_crypto_free(ptr);
+
+  return bytes;
 }
 
 void
 hypercore_crypto_free(void *ptr) {
+  struct header header = { 0 };
+  unsigned char *bytes = ptr;
+
   if (0 == ptr) {
     return;
+  }
+
+  bytes -= HEADER_BYTES;
+  memcpy(&header, bytes, sizeof(header));
+  count(-(long long) header.size);
+
+  // blocks go back to the scope they came from, whichever is current
+  if (0 != header.scope) {
+    header.scope->free(header.scope->ctx, bytes);
   } else if (0 != dealloc) {
-    (void) stats.free++;
-    dealloc(ptr);
+    dealloc(bytes);
+  } else if (0 != default_dealloc) {
+    default_dealloc(bytes);
   } else {
-    (void) stats.free++;
-    free(ptr);
+    free(bytes);
   }
 }
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hypercore/crypto/allocator.h"
+#include "hypercore/crypto/arena.h"
+
+#include "require.h"
+
+// each block is preceded by its rounded size, keeping 16 byte alignment
+#define HEADER_BYTES 16
+#define ALIGN(n) (((n) + 15) & ~((unsigned long int) 15))
+
+// hashes and signatures, with the header `hypercore_crypto_alloc()`
+// puts in front of them when the arena is installed
+static const unsigned long int classes[2] = {
+  32 + HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES,
+  64 + HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES
+};
+
+static int
+class_of(unsigned long int size) {
+  for (int i = 0; i < 2; ++i) {
+    if (size <= classes[i]) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int
+contains(const hypercore_crypto_arena_t *arena, const void *ptr) {
+  const unsigned char *bytes = ptr;
+  return bytes >= arena->bytes && bytes < arena->bytes + arena->size;
+}
+
+static void *
+scoped_alloc(void *ctx, unsigned long int size) {
+  return hypercore_crypto_arena_alloc(ctx, size);
+}
+
+static void
+scoped_free(void *ctx, void *ptr) {
+  hypercore_crypto_arena_free(ctx, ptr);
+}
+
+int
+hypercore_crypto_arena_init(
+  hypercore_crypto_arena_t *arena,
+  void *memory,
+  unsigned long int size
+) {
+  require(0 != arena, EFAULT);
+
+  if (0 == size) {
+    size = HYPERCORE_CRYPTO_ARENA_SIZE;
+  }
+
+  memset(arena, 0, sizeof(*arena));
+
+  if (0 == memory) {
+    memory = malloc(size);
+    require(0 != memory, ENOMEM);
+    arena->owned = 1;
+  } else {
+    // keep blocks 16 byte aligned regardless of where `memory` starts
+    unsigned long int skew =
+      ALIGN((unsigned long int) memory) - (unsigned long int) memory;
+
+    require(size > HEADER_BYTES + skew, EINVAL);
+
+    memory = (unsigned char *) memory + skew;
+    size -= skew;
+  }
+
+  arena->bytes = memory;
+  arena->size = size;
+  arena->allocator.ctx = arena;
+  arena->allocator.alloc = scoped_alloc;
+  arena->allocator.free = scoped_free;
+
+  return 0;
+}
+
+void
+hypercore_crypto_arena_destroy(hypercore_crypto_arena_t *arena) {
+  if (0 != arena) {
+    if (arena->owned) {
+      free(arena->bytes);
+    }
+
+    memset(arena, 0, sizeof(*arena));
+  }
+}
+
+void *
+hypercore_crypto_arena_alloc(hypercore_crypto_arena_t *arena, unsigned long int size) {
+  if (0 == arena || 0 == size) {
+    return 0;
+  }
+
+  int class = class_of(size);
+
+  if (class >= 0) {
+    size = classes[class];
+
+    if (0 != arena->recycle[class]) {
+      void *ptr = arena->recycle[class];
+      memcpy(&arena->recycle[class], ptr, sizeof(void *));
+      return ptr;
+    }
+  } else {
+    size = ALIGN(size);
+  }
+
+  if (HEADER_BYTES + size > arena->size - arena->offset) {
+    (void) arena->fallbacks++;
+    return malloc(size);
+  }
+
+  unsigned char *block = arena->bytes + arena->offset;
+  memcpy(block, &size, sizeof(size));
+  arena->offset += HEADER_BYTES + size;
+
+  return block + HEADER_BYTES;
+}
+
+void
+hypercore_crypto_arena_free(hypercore_crypto_arena_t *arena, void *ptr) {
+  if (0 == arena || 0 == ptr) {
+    return;
+  }
+
+  if (0 == contains(arena, ptr)) {
+    free(ptr);
+    return;
+  }
+
+  unsigned long int size = 0;
+  memcpy(&size, (unsigned char *) ptr - HEADER_BYTES, sizeof(size));
+
+  int class = class_of(size);
+
+  // larger blocks are only released by `hypercore_crypto_arena_reset()`
+  if (class >= 0 && size == classes[class]) {
+    memcpy(ptr, &arena->recycle[class], sizeof(void *));
+    arena->recycle[class] = ptr;
+  }
+}
+
+unsigned long int
+hypercore_crypto_arena_mark(const hypercore_crypto_arena_t *arena) {
+  return 0 == arena ? 0 : arena->offset;
+}
+
+void
+hypercore_crypto_arena_reset(hypercore_crypto_arena_t *arena, unsigned long int mark) {
+  if (0 == arena || mark > arena->offset) {
+    return;
+  }
+
+  arena->offset = mark;
+
+  // drop recycled blocks that now lie past the mark
+  for (int i = 0; i < 2; ++i) {
+    void **link = &arena->recycle[i];
+
+    while (0 != *link) {
+      unsigned char *block = *link;
+
+      if (block >= arena->bytes + mark) {
+        memcpy(link, block, sizeof(void *));
+      } else {
+        link = (void **) block;
+      }
+    }
+  }
+}
+
+void
+hypercore_crypto_arena_install(hypercore_crypto_arena_t *arena) {
+  if (0 != arena) {
+    hypercore_crypto_allocator_push(&arena->allocator);
+  }
+}
+
+void
+hypercore_crypto_arena_uninstall(hypercore_crypto_arena_t *arena) {
+  if (0 != arena) {
+    hypercore_crypto_allocator_pop();
+  }
+}
@@ -0,0 +1,136 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "hypercore/crypto/commit.h"
+
+#include "require.h"
+
+static unsigned long long
+now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int
+expired(const hypercore_crypto_commit_t *commit) {
+  return
+    commit->microseconds > 0 &&
+    now() - commit->pending_since >= commit->microseconds * 1000ULL;
+}
+
+static int
+sign(
+  hypercore_crypto_commit_t *commit,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length
+) {
+  int rc = hypercore_crypto_tree_hash_sign(
+    &commit->tree,
+    signature,
+    commit->secret_key);
+
+  if (0 != rc) {
+    return rc;
+  }
+
+  commit->signed_length = commit->length;
+
+  if (0 != length) {
+    *length = commit->length;
+  }
+
+  return 1;
+}
+
+int
+hypercore_crypto_commit_init(
+  hypercore_crypto_commit_t *commit,
+  const hypercore_crypto_buffer_t *secret_key,
+  hypercore_crypto_commit_options_t options
+) {
+  require(0 != commit, EFAULT);
+  require(0 != secret_key, EFAULT);
+
+  memset(commit, 0, sizeof(*commit));
+  hypercore_crypto_tree_hash_init(&commit->tree);
+
+  commit->secret_key = secret_key;
+  commit->blocks = options.blocks;
+  commit->microseconds = options.microseconds;
+
+  return 0;
+}
+
+int
+hypercore_crypto_commit_append(
+  hypercore_crypto_commit_t *commit,
+  const hypercore_crypto_node_t **nodes,
+  unsigned long long count,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length
+) {
+  require(0 != commit, EFAULT);
+  require(0 != nodes || 0 == count, EFAULT);
+
+  for (unsigned long long i = 0; i < count; ++i) {
+    int rc = hypercore_crypto_tree_hash_append(&commit->tree, nodes[i]);
+
+    if (0 != rc) {
+      return rc;
+    }
+
+    // leaves have even flat tree indices
+    if (0 == nodes[i]->index % 2) {
+      if (commit->length == commit->signed_length) {
+        commit->pending_since = now();
+      }
+
+      commit->length++;
+    }
+  }
+
+  if (commit->length == commit->signed_length) {
+    return 0;
+  }
+
+  if (
+    commit->length - commit->signed_length >= commit->blocks ||
+    expired(commit)
+  ) {
+    return sign(commit, signature, length);
+  }
+
+  return 0;
+}
+
+int
+hypercore_crypto_commit_poll(
+  hypercore_crypto_commit_t *commit,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length
+) {
+  require(0 != commit, EFAULT);
+
+  if (commit->length > commit->signed_length && expired(commit)) {
+    return sign(commit, signature, length);
+  }
+
+  return 0;
+}
+
+int
+hypercore_crypto_commit_flush(
+  hypercore_crypto_commit_t *commit,
+  hypercore_crypto_buffer_t *signature,
+  unsigned long long *length
+) {
+  require(0 != commit, EFAULT);
+
+  if (commit->length > commit->signed_length) {
+    return sign(commit, signature, length);
+  }
+
+  return 0;
+}
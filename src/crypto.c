@@ -1,17 +1,18 @@
+#include <flat-tree/flat-tree.h>
 #include <uint64be/uint64be.h>
 #include <sodium.h>
+#include <pthread.h>
 #include <string.h>
 #include <errno.h>
 
 #include "hypercore/crypto/allocator.h"
 #include "hypercore/crypto/crypto.h"
 
+#include "metrics.h"
+#include "probes.h"
+#include "random.h"
 #include "require.h"
-
-#define INIT_STATE() {                    \
-  int rc = hypercore_crypto_init_state(); \
-  if (0 != rc) { return rc; }             \
-}
+#include "state.h"
 
 static unsigned char DATA_TYPES[] = {
   HYPERCORE_CRYPTO_LEAF_BYTE,
@@ -19,14 +20,45 @@ static unsigned char DATA_TYPES[] = {
   HYPERCORE_CRYPTO_ROOT_BYTE
 };
 
-static int
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int init_rc = 0;
+
+static void
+init() {
+  init_rc = sodium_init();
+
+  // only a default, allocators set by the user are left in place
+  hypercore_crypto_allocator_default(sodium_malloc, sodium_free);
+}
+
+int
 hypercore_crypto_init_state() {
-  require(-1 != sodium_init(), 1);
-  hypercore_crypto_allocator_set(sodium_malloc);
-  hypercore_crypto_deallocator_set(sodium_free);
+  pthread_once(&init_once, init);
+  require(-1 != init_rc, 1);
   return 0;
 }
 
+#if defined(HYPERCORE_CRYPTO_METRICS) || defined(HYPERCORE_CRYPTO_PROBES)
+static unsigned long long
+size_of(const hypercore_crypto_buffer_t *buffer) {
+  return 0 != buffer ? buffer->size : 0;
+}
+#endif
+
+#ifdef HYPERCORE_CRYPTO_METRICS
+// bytes of root hashes, indices and lengths hashed by `tree()`
+static unsigned long long
+roots_size(const hypercore_crypto_node_t **roots, unsigned long long count) {
+  unsigned long long size = 0;
+
+  for (unsigned long long i = 0; 0 != roots && i < count; ++i) {
+    size += 16 + (0 != roots[i] ? size_of(roots[i]->hash) : 0);
+  }
+
+  return size;
+}
+#endif
+
 static int
 blake2b(
   hypercore_crypto_buffer_t *out,
@@ -75,14 +107,15 @@ blake2b(
   return rc;
 }
 
-int
-hypercore_crypto_keypair(
+static int
+keypair(
   hypercore_crypto_keypair_t *kp,
   const unsigned char *seed
 ) {
   INIT_STATE();
 
-  int allocs = 0;
+  int public_allocated = 0;
+  int secret_allocated = 0;
   int rc = 0;
 
   require(0 != kp, EFAULT);
@@ -92,23 +125,22 @@ hypercore_crypto_keypair(
 
     require(0 != kp->public_key.bytes, ENOMEM);
     kp->public_key.size = crypto_sign_PUBLICKEYBYTES;
-    (void) allocs++;
+    public_allocated = 1;
   }
 
   if (0 == kp->secret_key.bytes) {
-    kp->secret_key.bytes = hypercore_crypto_alloc(crypto_sign_SECRETKEYBYTES);
+    // never served by an allocator scope, see `hypercore_crypto_keypair()`
+    kp->secret_key.bytes = sodium_malloc(crypto_sign_SECRETKEYBYTES);
 
-    if (0 == kp->secret_key.bytes) {
-      if (0 == --allocs) {
-        hypercore_crypto_free(kp->public_key.bytes);
-        kp->public_key.bytes = 0;
-        kp->public_key.size = 0;
-      }
+    if (0 == kp->secret_key.bytes && public_allocated) {
+      hypercore_crypto_free(kp->public_key.bytes);
+      kp->public_key.bytes = 0;
+      kp->public_key.size = 0;
     }
 
     require(0 != kp->secret_key.bytes, ENOMEM);
     kp->secret_key.size = crypto_sign_SECRETKEYBYTES;
-    (void) allocs++;
+    secret_allocated = 1;
   }
 
   if (0 != seed) {
@@ -121,14 +153,14 @@ hypercore_crypto_keypair(
   }
 
   if (0 != rc) {
-    if (allocs-- > 0)  {
+    if (public_allocated) {
       hypercore_crypto_free(kp->public_key.bytes);
       kp->public_key.bytes = 0;
       kp->public_key.size = 0;
     }
 
-    if (allocs-- > 0)  {
-      hypercore_crypto_free(kp->secret_key.bytes);
+    if (secret_allocated) {
+      sodium_free(kp->secret_key.bytes);
       kp->secret_key.bytes = 0;
       kp->secret_key.size = 0;
     }
@@ -137,6 +169,15 @@ hypercore_crypto_keypair(
   return rc;
 }
 
+int
+hypercore_crypto_keypair(
+  hypercore_crypto_keypair_t *kp,
+  const unsigned char *seed
+) {
+  METRICS_START();
+  return METRICS_END(HYPERCORE_CRYPTO_METRICS_KEYPAIR, 0, keypair(kp, seed));
+}
+
 void
 hypercore_crypto_keypair_destroy(hypercore_crypto_keypair_t *kp) {
   if (0 != kp) {
@@ -147,15 +188,15 @@ hypercore_crypto_keypair_destroy(hypercore_crypto_keypair_t *kp) {
     }
 
     if (0 != kp->secret_key.bytes) {
-      hypercore_crypto_free(kp->secret_key.bytes);
+      sodium_free(kp->secret_key.bytes);
       kp->secret_key.bytes = 0;
       kp->secret_key.size = 0;
     }
   }
 }
 
-int
-hypercore_crypto_sign(
+static int
+sign(
   hypercore_crypto_buffer_t *signature,
   const hypercore_crypto_buffer_t *message,
   const hypercore_crypto_buffer_t *secret_key
@@ -191,7 +232,26 @@ hypercore_crypto_sign(
 }
 
 int
-hypercore_crypto_verify(
+hypercore_crypto_sign(
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *message,
+  const hypercore_crypto_buffer_t *secret_key
+) {
+  int rc = 0;
+
+  PROBE1(sign__entry, size_of(message));
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_SIGN,
+    size_of(message),
+    sign(signature, message, secret_key));
+  PROBE1(sign__return, rc);
+
+  return rc;
+}
+
+static int
+verify(
   hypercore_crypto_buffer_t *signature,
   const hypercore_crypto_buffer_t *message,
   const hypercore_crypto_buffer_t *public_key
@@ -218,7 +278,26 @@ hypercore_crypto_verify(
 }
 
 int
-hypercore_crypto_data(
+hypercore_crypto_verify(
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *message,
+  const hypercore_crypto_buffer_t *public_key
+) {
+  int rc = 0;
+
+  PROBE1(verify__entry, size_of(message));
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_VERIFY,
+    size_of(message),
+    verify(signature, message, public_key));
+  PROBE1(verify__return, rc);
+
+  return rc;
+}
+
+static int
+data(
   hypercore_crypto_buffer_t *out,
   const hypercore_crypto_buffer_t *data
 ) {
@@ -236,7 +315,8 @@ hypercore_crypto_data(
     data
   };
 
-  if (uint64be_encode(length.bytes, data->size) <= 0) {
+  // encodes nothing for `0`, leaving the zeroed bytes in place
+  if (uint64be_encode(length.bytes, data->size) < 0) {
     return -1;
   }
 
@@ -251,6 +331,24 @@ hypercore_crypto_data(
   return blake2b(out, buffers, 3);
 }
 
+int
+hypercore_crypto_data(
+  hypercore_crypto_buffer_t *out,
+  const hypercore_crypto_buffer_t *input
+) {
+  int rc = 0;
+
+  PROBE1(data__entry, size_of(input));
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_DATA,
+    size_of(input),
+    data(out, input));
+  PROBE1(data__return, rc);
+
+  return rc;
+}
+
 int
 hypercore_crypto_leaf(
   hypercore_crypto_buffer_t *out,
@@ -259,8 +357,8 @@ hypercore_crypto_leaf(
   return hypercore_crypto_data(out, leaf->data);
 }
 
-int
-hypercore_crypto_parent(
+static int
+parent(
   hypercore_crypto_buffer_t *out,
   const hypercore_crypto_node_t *left,
   const hypercore_crypto_node_t *right
@@ -287,7 +385,7 @@ hypercore_crypto_parent(
     right->hash
   };
 
-  if (uint64be_encode(length.bytes, left->size  + right->size) <= 0) {
+  if (uint64be_encode(length.bytes, left->size  + right->size) < 0) {
     return -1;
   }
 
@@ -303,7 +401,30 @@ hypercore_crypto_parent(
 }
 
 int
-hypercore_crypto_tree(
+hypercore_crypto_parent(
+  hypercore_crypto_buffer_t *out,
+  const hypercore_crypto_node_t *left,
+  const hypercore_crypto_node_t *right
+) {
+  int rc = 0;
+
+  PROBE3(parent__entry,
+    0 != left ? left->index : 0,
+    0 != right ? right->index : 0,
+    (0 != left ? left->size : 0) + (0 != right ? right->size : 0));
+
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_PARENT,
+    (0 != left ? size_of(left->hash) : 0) + (0 != right ? size_of(right->hash) : 0),
+    parent(out, left, right));
+  PROBE1(parent__return, rc);
+
+  return rc;
+}
+
+static int
+tree(
   hypercore_crypto_buffer_t *out,
   const hypercore_crypto_node_t **roots,
   unsigned long long count
@@ -318,10 +439,9 @@ hypercore_crypto_tree(
   // root=2
   const hypercore_crypto_buffer_t header = { 1, DATA_TYPES + 2 };
   const hypercore_crypto_buffer_t *buffers[size];
-  hypercore_crypto_buffer_t indices[size];
-  hypercore_crypto_buffer_t lengths[size];
-
-  memset(buffers, 0, size);
+  hypercore_crypto_buffer_t indices[count + 1];
+  hypercore_crypto_buffer_t lengths[count + 1];
+  unsigned char encoded[count + 1][16];
 
   unsigned int j = 0;
   buffers[j++] = &header;
@@ -331,15 +451,17 @@ hypercore_crypto_tree(
     buffers[j++] = &indices[i];
     buffers[j++] = &lengths[i];
 
-    indices[i].bytes = hypercore_crypto_alloc(8);
+    indices[i].bytes = encoded[i];
     indices[i].size = 8;
 
-    lengths[i].bytes = hypercore_crypto_alloc(8);
+    lengths[i].bytes = encoded[i] + 8;
     lengths[i].size = 8;
 
+    memset(encoded[i], 0, sizeof(encoded[i]));
+
     if (
-      uint64be_encode(indices[i].bytes, roots[i]->index) <= 0 ||
-      uint64be_encode(lengths[i].bytes, roots[i]->size) <= 0
+      uint64be_encode(indices[i].bytes, roots[i]->index) < 0 ||
+      uint64be_encode(lengths[i].bytes, roots[i]->size) < 0
     ) {
       return -1;
     }
@@ -356,6 +478,188 @@ hypercore_crypto_tree(
   return blake2b(out, buffers, size);
 }
 
+int
+hypercore_crypto_tree(
+  hypercore_crypto_buffer_t *out,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count
+) {
+  int rc = 0;
+
+  PROBE1(tree__entry, count);
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_TREE,
+    roots_size(roots, count),
+    tree(out, roots, count));
+  PROBE1(tree__return, rc);
+
+  return rc;
+}
+
+static int
+sign_roots(
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count,
+  const hypercore_crypto_buffer_t *secret_key
+) {
+  unsigned char bytes[hypercore_crypto_data_BYTES];
+  hypercore_crypto_buffer_t hash = { sizeof(bytes), bytes };
+  int rc = 0;
+
+  require(0 != signature, EFAULT);
+  require(0 != secret_key, EFAULT);
+
+  rc = tree(&hash, roots, count);
+
+  if (0 == rc) {
+    rc = sign(signature, &hash, secret_key);
+  }
+
+  return rc;
+}
+
+int
+hypercore_crypto_sign_roots(
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count,
+  const hypercore_crypto_buffer_t *secret_key
+) {
+  int rc = 0;
+
+  PROBE1(sign_roots__entry, count);
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_SIGN_ROOTS,
+    roots_size(roots, count),
+    sign_roots(signature, roots, count, secret_key));
+  PROBE1(sign_roots__return, rc);
+
+  return rc;
+}
+
+static int
+verify_block(
+  const hypercore_crypto_buffer_t *block,
+  unsigned long long index,
+  const hypercore_crypto_node_t **siblings,
+  unsigned long long siblings_count,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long roots_count,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *public_key
+) {
+  INIT_STATE();
+
+  unsigned char hashes[2][hypercore_crypto_data_BYTES];
+  hypercore_crypto_buffer_t buffers[2] = {
+    { sizeof(hashes[0]), hashes[0] },
+    { sizeof(hashes[1]), hashes[1] }
+  };
+
+  hypercore_crypto_node_t node = { 0 };
+  const hypercore_crypto_node_t *root = 0;
+  int rc = 0;
+
+  require(0 != block, EFAULT);
+  require(0 != siblings || 0 == siblings_count, EFAULT);
+  require(0 != roots && roots_count > 0, EFAULT);
+
+  rc = data(&buffers[0], block);
+
+  if (0 != rc) {
+    return rc;
+  }
+
+  node.index = 2 * index;
+  node.size = block->size;
+  node.hash = &buffers[0];
+
+  // hash up to the root, alternating between the two scratch hashes
+  for (unsigned long long i = 0; i < siblings_count; ++i) {
+    const hypercore_crypto_node_t *sibling = siblings[i];
+    hypercore_crypto_buffer_t *hash = &buffers[(i + 1) % 2];
+
+    require(0 != sibling && 0 != sibling->hash, EFAULT);
+
+    if (sibling->index != ft_sibling(node.index, 0)) {
+      return -1;
+    }
+
+    rc = parent(hash, &node, sibling);
+
+    if (0 != rc) {
+      return rc;
+    }
+
+    node.index = ft_parent(node.index, 0);
+    node.size += sibling->size;
+    node.hash = hash;
+  }
+
+  for (unsigned long long i = 0; 0 == root && i < roots_count; ++i) {
+    require(0 != roots[i], EFAULT);
+
+    if (node.index == roots[i]->index) {
+      root = roots[i];
+    }
+  }
+
+  if (
+    0 == root ||
+    0 == root->hash ||
+    0 == root->hash->bytes ||
+    node.size != root->size ||
+    node.hash->size != root->hash->size ||
+    0 != memcmp(node.hash->bytes, root->hash->bytes, node.hash->size)
+  ) {
+    return -1;
+  }
+
+  // the block is under a root, now the roots have to be signed
+  rc = tree(&buffers[0], roots, roots_count);
+
+  if (0 != rc) {
+    return rc;
+  }
+
+  return verify(signature, &buffers[0], public_key);
+}
+
+int
+hypercore_crypto_verify_block(
+  const hypercore_crypto_buffer_t *block,
+  unsigned long long index,
+  const hypercore_crypto_node_t **siblings,
+  unsigned long long siblings_count,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long roots_count,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *public_key
+) {
+  int rc = 0;
+
+  PROBE2(verify_block__entry, size_of(block), index);
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_VERIFY_BLOCK,
+    size_of(block),
+    verify_block(
+      block,
+      index,
+      siblings,
+      siblings_count,
+      roots,
+      roots_count,
+      signature,
+      public_key));
+  PROBE1(verify_block__return, rc);
+
+  return rc;
+}
+
 int
 hypercore_crypto_randombytes(hypercore_crypto_buffer_t *out) {
   require(0 != out, EFAULT);
@@ -366,16 +670,16 @@ hypercore_crypto_randombytes(hypercore_crypto_buffer_t *out) {
     }
 
     out->bytes = hypercore_crypto_alloc(out->size);
-    memset(out->bytes, 0, out->size);
+    require(0 != out->bytes, ENOMEM);
   }
 
-  randombytes_buf(out->bytes, out->size);
+  hypercore_crypto_randombytes_fill(out->bytes, out->size);
 
   return out->size;
 }
 
-int
-hypercore_crypto_discoverykey(
+static int
+discoverykey(
   hypercore_crypto_buffer_t *out,
   hypercore_crypto_buffer_t *tree
 ) {
@@ -400,3 +704,61 @@ hypercore_crypto_discoverykey(
 
   return out->size;
 }
+
+int
+hypercore_crypto_discoverykey(
+  hypercore_crypto_buffer_t *out,
+  hypercore_crypto_buffer_t *tree
+) {
+  METRICS_START();
+  return METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_DISCOVERYKEY,
+    size_of(tree),
+    discoverykey(out, tree));
+}
+
+int
+hypercore_crypto_discoverykey_many(
+  hypercore_crypto_buffer_t *out,
+  const hypercore_crypto_buffer_t *keys,
+  unsigned long long count
+) {
+  INIT_STATE();
+
+  unsigned long long size = count * crypto_generichash_BYTES;
+  int rc = 0;
+
+  require(0 != out, EFAULT);
+  require(0 != keys || 0 == count, EFAULT);
+  require(count <= (unsigned long long) -1 / crypto_generichash_BYTES, ERANGE);
+
+  if (0 == count) {
+    return 0;
+  }
+
+  if (0 == out->bytes) {
+    out->bytes = hypercore_crypto_alloc(size);
+    require(0 != out->bytes, ENOMEM);
+    out->size = size;
+  }
+
+  require(out->size >= size, EINVAL);
+
+  for (unsigned long long i = 0; i < count; ++i) {
+    rc = crypto_generichash(
+      out->bytes + i * crypto_generichash_BYTES,
+      crypto_generichash_BYTES,
+      HYPERCORE_CRYPTO_KEY_BYTES,
+      sizeof(HYPERCORE_CRYPTO_KEY_BYTES),
+      keys[i].bytes,
+      keys[i].size);
+
+    if (0 != rc) {
+      return rc;
+    }
+  }
+
+  out->size = size;
+
+  return 0;
+}
@@ -0,0 +1,203 @@
+#include <sodium.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hypercore/crypto/allocator.h"
+#include "hypercore/crypto/crypto.h"
+
+#include "require.h"
+#include "state.h"
+
+#ifndef HYPERCORE_CRYPTO_DERIVE_MAX_THREADS
+#define HYPERCORE_CRYPTO_DERIVE_MAX_THREADS 64
+#endif
+
+// minimum number of keypairs a derive thread is given
+#ifndef HYPERCORE_CRYPTO_DERIVE_BATCH
+#define HYPERCORE_CRYPTO_DERIVE_BATCH 256
+#endif
+
+struct derive_work {
+  const crypto_generichash_state *keyed;
+  const hypercore_crypto_buffer_t *names;
+  hypercore_crypto_keypair_t *keypairs;
+  unsigned long long offset;
+  unsigned long long count;
+  int rc;
+};
+
+static void *
+derive(void *arg) {
+  struct derive_work *work = arg;
+  crypto_generichash_state state;
+  unsigned char seed[crypto_sign_SEEDBYTES];
+
+  for (unsigned long long i = work->offset; i < work->offset + work->count; ++i) {
+    hypercore_crypto_keypair_t *kp = &work->keypairs[i];
+    const hypercore_crypto_buffer_t *name = &work->names[i];
+
+    memcpy(&state, work->keyed, sizeof(state));
+
+    if (
+      0 != crypto_generichash_update(&state, name->bytes, name->size) ||
+      0 != crypto_generichash_final(&state, seed, sizeof(seed)) ||
+      0 != crypto_sign_seed_keypair(
+        kp->public_key.bytes,
+        kp->secret_key.bytes,
+        seed)
+    ) {
+      work->rc = -1;
+      break;
+    }
+  }
+
+  sodium_memzero(&state, sizeof(state));
+  sodium_memzero(seed, sizeof(seed));
+  return 0;
+}
+
+static unsigned long int
+derive_threads(unsigned long long count) {
+  long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned long long threads = count / HYPERCORE_CRYPTO_DERIVE_BATCH;
+
+  if (cpus < 1) {
+    cpus = 1;
+  }
+
+  if (threads > (unsigned long long) cpus) {
+    threads = cpus;
+  }
+
+  if (threads > HYPERCORE_CRYPTO_DERIVE_MAX_THREADS) {
+    threads = HYPERCORE_CRYPTO_DERIVE_MAX_THREADS;
+  }
+
+  return 0 == threads ? 1 : threads;
+}
+
+int
+hypercore_crypto_keypair_derive_many(
+  const unsigned char *master,
+  const hypercore_crypto_buffer_t *names,
+  unsigned long long count,
+  hypercore_crypto_keypair_t *keypairs
+) {
+  INIT_STATE();
+
+  require(0 != master, EFAULT);
+  require(0 != names || 0 == count, EFAULT);
+  require(0 != keypairs || 0 == count, EFAULT);
+  require(count <= (unsigned long long) -1 / crypto_sign_SECRETKEYBYTES, ERANGE);
+
+  if (0 == count) {
+    return 0;
+  }
+
+  struct derive_work work[HYPERCORE_CRYPTO_DERIVE_MAX_THREADS];
+  pthread_t threads[HYPERCORE_CRYPTO_DERIVE_MAX_THREADS];
+  crypto_generichash_state keyed;
+  unsigned long int nthreads = derive_threads(count);
+  unsigned long int started = 0;
+  unsigned char *public_keys = 0;
+  unsigned char *secret_keys = 0;
+  int rc = 0;
+
+  public_keys = hypercore_crypto_alloc(count * crypto_sign_PUBLICKEYBYTES);
+  require(0 != public_keys, ENOMEM);
+
+  secret_keys = sodium_malloc(count * crypto_sign_SECRETKEYBYTES);
+
+  if (0 == secret_keys) {
+    hypercore_crypto_free(public_keys);
+  }
+
+  require(0 != secret_keys, ENOMEM);
+
+  for (unsigned long long i = 0; i < count; ++i) {
+    keypairs[i].public_key.bytes = public_keys + i * crypto_sign_PUBLICKEYBYTES;
+    keypairs[i].public_key.size = crypto_sign_PUBLICKEYBYTES;
+    keypairs[i].secret_key.bytes = secret_keys + i * crypto_sign_SECRETKEYBYTES;
+    keypairs[i].secret_key.size = crypto_sign_SECRETKEYBYTES;
+  }
+
+  // seed = blake2b(key=master, "hypercore" || name)
+  rc = crypto_generichash_init(
+    &keyed,
+    master,
+    crypto_sign_SEEDBYTES,
+    crypto_sign_SEEDBYTES);
+
+  if (0 == rc) {
+    rc = crypto_generichash_update(
+      &keyed,
+      HYPERCORE_CRYPTO_KEY_BYTES,
+      sizeof(HYPERCORE_CRYPTO_KEY_BYTES));
+  }
+
+  for (unsigned long int i = 0; 0 == rc && i < nthreads; ++i) {
+    unsigned long long offset = count * i / nthreads;
+
+    work[i] = (struct derive_work) {
+      .keyed = &keyed,
+      .names = names,
+      .keypairs = keypairs,
+      .offset = offset,
+      .count = count * (i + 1) / nthreads - offset,
+      .rc = 0
+    };
+  }
+
+  // the calling thread derives the first batch itself
+  for (unsigned long int i = 1; 0 == rc && i < nthreads; ++i) {
+    if (0 != pthread_create(&threads[i], 0, derive, &work[i])) {
+      break;
+    }
+
+    (void) started++;
+  }
+
+  if (0 == rc) {
+    derive(&work[0]);
+    rc = work[0].rc;
+
+    // derive batches that could not be given to a thread
+    for (unsigned long int i = started + 1; i < nthreads; ++i) {
+      derive(&work[i]);
+      rc = 0 == rc ? work[i].rc : rc;
+    }
+  }
+
+  for (unsigned long int i = 1; i <= started; ++i) {
+    pthread_join(threads[i], 0);
+    rc = 0 == rc ? work[i].rc : rc;
+  }
+
+  sodium_memzero(&keyed, sizeof(keyed));
+
+  if (0 != rc) {
+    hypercore_crypto_keypair_destroy_many(keypairs, count);
+  }
+
+  return rc;
+}
+
+void
+hypercore_crypto_keypair_destroy_many(
+  hypercore_crypto_keypair_t *keypairs,
+  unsigned long long count
+) {
+  if (0 != keypairs && count > 0) {
+    hypercore_crypto_free(keypairs[0].public_key.bytes);
+    sodium_free(keypairs[0].secret_key.bytes);
+
+    for (unsigned long long i = 0; i < count; ++i) {
+      keypairs[i].public_key.bytes = 0;
+      keypairs[i].public_key.size = 0;
+      keypairs[i].secret_key.bytes = 0;
+      keypairs[i].secret_key.size = 0;
+    }
+  }
+}
@@ -0,0 +1,412 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "hypercore/crypto/allocator.h"
+#include "hypercore/crypto/crypto.h"
+#include "hypercore/crypto/jobs.h"
+
+#include "require.h"
+#include "state.h"
+
+struct hypercore_crypto_jobs_queue {
+  hypercore_crypto_jobs_t *jobs;
+  hypercore_crypto_job_t *head;
+  hypercore_crypto_job_t *tail;
+  unsigned long int index;
+  pthread_mutex_t mutex;
+  pthread_t thread;
+};
+
+static int
+notify_init(hypercore_crypto_jobs_t *jobs) {
+#if defined(__linux__)
+  jobs->fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  jobs->fds[1] = jobs->fds[0];
+  return jobs->fds[0] < 0 ? -1 : 0;
+#else
+  if (0 != pipe(jobs->fds)) {
+    return -1;
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    fcntl(jobs->fds[i], F_SETFL, fcntl(jobs->fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(jobs->fds[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  return 0;
+#endif
+}
+
+static void
+notify_close(hypercore_crypto_jobs_t *jobs) {
+  close(jobs->fds[0]);
+
+  if (jobs->fds[1] != jobs->fds[0]) {
+    close(jobs->fds[1]);
+  }
+}
+
+static void
+notify(hypercore_crypto_jobs_t *jobs) {
+#if defined(__linux__)
+  unsigned long long value = 1;
+#else
+  unsigned char value = 1;
+#endif
+
+  // a full pipe or counter is already readable
+  (void) !write(jobs->fds[1], &value, sizeof(value));
+}
+
+static void
+notify_drain(hypercore_crypto_jobs_t *jobs) {
+  unsigned long long value = 0;
+  while (read(jobs->fds[0], &value, sizeof(value)) > 0) {
+    continue;
+  }
+}
+
+static unsigned long int
+take(
+  hypercore_crypto_jobs_queue_t *queue,
+  hypercore_crypto_job_t **batch,
+  unsigned long int max
+) {
+  unsigned long int count = 0;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  while (count < max && 0 != queue->head) {
+    batch[count++] = queue->head;
+    queue->head = queue->head->next;
+  }
+
+  if (0 == queue->head) {
+    queue->tail = 0;
+  }
+
+  pthread_mutex_unlock(&queue->mutex);
+
+  return count;
+}
+
+static void
+complete(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_job_t **batch,
+  unsigned long int count
+) {
+  hypercore_crypto_job_t *head = 0;
+  hypercore_crypto_job_t *tail = 0;
+
+  for (unsigned long int i = 0; i < count; ++i) {
+    hypercore_crypto_job_t *job = batch[i];
+
+    job->next = 0;
+
+    if (0 != job->callback) {
+      job->callback(job);
+    } else if (0 == head) {
+      head = tail = job;
+    } else {
+      tail->next = job;
+      tail = job;
+    }
+  }
+
+  // one lock and one wake up for the whole batch
+  if (0 != head) {
+    pthread_mutex_lock(&jobs->completed_mutex);
+
+    if (0 == jobs->completed) {
+      jobs->completed = head;
+    } else {
+      jobs->completed_tail->next = head;
+    }
+
+    jobs->completed_tail = tail;
+    pthread_mutex_unlock(&jobs->completed_mutex);
+    notify(jobs);
+  }
+}
+
+static void *
+run(void *arg) {
+  hypercore_crypto_jobs_queue_t *queue = arg;
+  hypercore_crypto_jobs_t *jobs = queue->jobs;
+  hypercore_crypto_job_t *batch[HYPERCORE_CRYPTO_JOBS_BATCH];
+  unsigned long int generation = 0;
+
+  pthread_mutex_lock(&jobs->mutex);
+  generation = jobs->generation;
+  pthread_mutex_unlock(&jobs->mutex);
+
+  while (1) {
+    unsigned long int count = take(queue, batch, HYPERCORE_CRYPTO_JOBS_BATCH);
+
+    // steal from the other workers when the own queue is empty
+    for (unsigned long int i = 1; 0 == count && i < jobs->length; ++i) {
+      hypercore_crypto_jobs_queue_t *victim =
+        &jobs->queues[(queue->index + i) % jobs->length];
+
+      count = take(victim, batch, HYPERCORE_CRYPTO_JOBS_BATCH);
+    }
+
+    pthread_mutex_lock(&jobs->mutex);
+
+    if (0 == count) {
+      if (0 == jobs->pending && 0 == jobs->running) {
+        pthread_mutex_unlock(&jobs->mutex);
+        break;
+      }
+
+      // pending jobs were taken by other workers, so sleep until a
+      // submission newer than the take above or the last job is taken
+      if (generation == jobs->generation) {
+        pthread_cond_wait(&jobs->cond, &jobs->mutex);
+      }
+
+      generation = jobs->generation;
+      pthread_mutex_unlock(&jobs->mutex);
+      continue;
+    }
+
+    jobs->pending -= count;
+
+    // workers waiting out the jobs in flight can stop
+    if (0 == jobs->pending) {
+      pthread_cond_broadcast(&jobs->cond);
+    }
+
+    generation = jobs->generation;
+    pthread_mutex_unlock(&jobs->mutex);
+
+    for (unsigned long int i = 0; i < count; ++i) {
+      hypercore_crypto_job_run(batch[i]);
+    }
+
+    complete(jobs, batch, count);
+  }
+
+  return 0;
+}
+
+int
+hypercore_crypto_job_run(hypercore_crypto_job_t *job) {
+  require(0 != job, EFAULT);
+
+  switch (job->type) {
+    case HYPERCORE_CRYPTO_JOB_DATA:
+      job->rc = hypercore_crypto_data(job->out, job->message);
+      break;
+
+    case HYPERCORE_CRYPTO_JOB_PARENT:
+      job->rc = hypercore_crypto_parent(job->out, job->left, job->right);
+      break;
+
+    case HYPERCORE_CRYPTO_JOB_TREE:
+      job->rc = hypercore_crypto_tree(job->out, job->roots, job->count);
+      break;
+
+    case HYPERCORE_CRYPTO_JOB_SIGN:
+      job->rc = hypercore_crypto_sign(job->out, job->message, job->key);
+      break;
+
+    case HYPERCORE_CRYPTO_JOB_VERIFY:
+      job->rc = hypercore_crypto_verify(job->out, job->message, job->key);
+      break;
+
+    default:
+      job->rc = -EINVAL;
+  }
+
+  return job->rc;
+}
+
+int
+hypercore_crypto_jobs_init(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_jobs_options_t options
+) {
+  INIT_STATE();
+
+  require(0 != jobs, EFAULT);
+
+  if (0 == options.threads) {
+    options.threads = HYPERCORE_CRYPTO_JOBS_THREADS;
+  }
+
+  memset(jobs, 0, sizeof(*jobs));
+  jobs->queues = hypercore_crypto_alloc(options.threads * sizeof(*jobs->queues));
+
+  require(0 != jobs->queues, ENOMEM);
+
+  if (0 != notify_init(jobs)) {
+    hypercore_crypto_free(jobs->queues);
+    jobs->queues = 0;
+    require(0, EMFILE);
+  }
+
+  pthread_mutex_init(&jobs->mutex, 0);
+  pthread_mutex_init(&jobs->completed_mutex, 0);
+  pthread_cond_init(&jobs->cond, 0);
+  jobs->running = 1;
+
+  for (unsigned long int i = 0; i < options.threads; ++i) {
+    hypercore_crypto_jobs_queue_t *queue = &jobs->queues[i];
+
+    memset(queue, 0, sizeof(*queue));
+    queue->jobs = jobs;
+    queue->index = i;
+    pthread_mutex_init(&queue->mutex, 0);
+  }
+
+  // `length` is read by workers while stealing so it is set up front
+  jobs->length = options.threads;
+
+  for (unsigned long int i = 0; i < options.threads; ++i) {
+    hypercore_crypto_jobs_queue_t *queue = &jobs->queues[i];
+
+    if (0 != pthread_create(&queue->thread, 0, run, queue)) {
+      // stop and join the workers that did start
+      pthread_mutex_lock(&jobs->mutex);
+      jobs->length = i;
+      pthread_mutex_unlock(&jobs->mutex);
+      hypercore_crypto_jobs_destroy(jobs);
+      require(0, EAGAIN);
+    }
+  }
+
+  return 0;
+}
+
+void
+hypercore_crypto_jobs_destroy(hypercore_crypto_jobs_t *jobs) {
+  if (0 == jobs || 0 == jobs->queues) {
+    return;
+  }
+
+  pthread_mutex_lock(&jobs->mutex);
+  jobs->running = 0;
+  pthread_cond_broadcast(&jobs->cond);
+  pthread_mutex_unlock(&jobs->mutex);
+
+  for (unsigned long int i = 0; i < jobs->length; ++i) {
+    pthread_join(jobs->queues[i].thread, 0);
+  }
+
+  for (unsigned long int i = 0; i < jobs->length; ++i) {
+    pthread_mutex_destroy(&jobs->queues[i].mutex);
+  }
+
+  pthread_cond_destroy(&jobs->cond);
+  pthread_mutex_destroy(&jobs->completed_mutex);
+  pthread_mutex_destroy(&jobs->mutex);
+  notify_close(jobs);
+
+  hypercore_crypto_free(jobs->queues);
+  memset(jobs, 0, sizeof(*jobs));
+}
+
+int
+hypercore_crypto_jobs_submit(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_job_t **list,
+  unsigned long int count
+) {
+  require(0 != jobs, EFAULT);
+  require(0 != list || 0 == count, EFAULT);
+  require(jobs->length > 0, EINVAL);
+
+  unsigned long int length = jobs->length;
+  unsigned long int start = 0;
+
+  // counted before the jobs are queued so `pending` never underflows
+  pthread_mutex_lock(&jobs->mutex);
+  start = jobs->next;
+  jobs->next = (jobs->next + 1) % length;
+  jobs->pending += count;
+  pthread_mutex_unlock(&jobs->mutex);
+
+  // spread the jobs in contiguous runs so each worker gets whole batches
+  for (unsigned long int i = 0; i < length; ++i) {
+    hypercore_crypto_jobs_queue_t *queue = &jobs->queues[(start + i) % length];
+    unsigned long int begin = count * i / length;
+    unsigned long int end = count * (i + 1) / length;
+
+    if (begin == end) {
+      continue;
+    }
+
+    for (unsigned long int j = begin; j < end; ++j) {
+      list[j]->next = j + 1 < end ? list[j + 1] : 0;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (0 == queue->tail) {
+      queue->head = list[begin];
+    } else {
+      queue->tail->next = list[begin];
+    }
+
+    queue->tail = list[end - 1];
+    pthread_mutex_unlock(&queue->mutex);
+  }
+
+  pthread_mutex_lock(&jobs->mutex);
+  (void) jobs->generation++;
+  pthread_cond_broadcast(&jobs->cond);
+  pthread_mutex_unlock(&jobs->mutex);
+
+  return 0;
+}
+
+int
+hypercore_crypto_jobs_fd(const hypercore_crypto_jobs_t *jobs) {
+  require(0 != jobs, EFAULT);
+  return jobs->fds[0];
+}
+
+unsigned long int
+hypercore_crypto_jobs_poll(
+  hypercore_crypto_jobs_t *jobs,
+  hypercore_crypto_job_t **list,
+  unsigned long int max
+) {
+  unsigned long int count = 0;
+  int remaining = 0;
+
+  if (0 == jobs || 0 == list) {
+    return 0;
+  }
+
+  notify_drain(jobs);
+  pthread_mutex_lock(&jobs->completed_mutex);
+
+  while (count < max && 0 != jobs->completed) {
+    list[count++] = jobs->completed;
+    jobs->completed = jobs->completed->next;
+  }
+
+  if (0 == jobs->completed) {
+    jobs->completed_tail = 0;
+  }
+
+  remaining = 0 != jobs->completed;
+  pthread_mutex_unlock(&jobs->completed_mutex);
+
+  // keep the descriptor readable while completions remain
+  if (remaining) {
+    notify(jobs);
+  }
+
+  return count;
+}
@@ -0,0 +1,247 @@
+#include <sodium.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hypercore/crypto/allocator.h"
+#include "hypercore/crypto/keyring.h"
+#include "hypercore/crypto/crypto.h"
+
+#include "require.h"
+#include "state.h"
+
+// bytes of an allocation bitmap covering `slots` slots
+#define BITMAP_BYTES(slots) (((slots) + 7) / 8)
+
+static int
+allocated(const hypercore_crypto_keyring_t *keyring, unsigned long int slot) {
+  return 0 != (keyring->allocated[slot / 8] & (1 << (slot % 8)));
+}
+
+static int
+grow(hypercore_crypto_keyring_t *keyring) {
+  unsigned long int slots = keyring->region_slots;
+  unsigned long int length = keyring->length;
+  unsigned char *region = 0;
+
+  if (length == keyring->capacity) {
+    unsigned long int capacity = 0 == length ? 1 : 2 * length;
+    unsigned char **regions = 0;
+    unsigned long int *stack = 0;
+    unsigned char *bitmap = 0;
+
+    regions = hypercore_crypto_alloc(capacity * sizeof(*regions));
+    require(0 != regions, ENOMEM);
+
+    stack = hypercore_crypto_alloc(capacity * slots * sizeof(*stack));
+    bitmap = hypercore_crypto_alloc(BITMAP_BYTES(capacity * slots));
+
+    if (0 == stack || 0 == bitmap) {
+      hypercore_crypto_free(regions);
+      hypercore_crypto_free(stack);
+      hypercore_crypto_free(bitmap);
+    }
+
+    require(0 != stack && 0 != bitmap, ENOMEM);
+
+    memset(bitmap, 0, BITMAP_BYTES(capacity * slots));
+
+    if (length > 0) {
+      memcpy(regions, keyring->regions, length * sizeof(*regions));
+      memcpy(stack, keyring->free, keyring->free_length * sizeof(*stack));
+      memcpy(bitmap, keyring->allocated, BITMAP_BYTES(length * slots));
+    }
+
+    hypercore_crypto_free(keyring->regions);
+    hypercore_crypto_free(keyring->free);
+    hypercore_crypto_free(keyring->allocated);
+
+    keyring->regions = regions;
+    keyring->free = stack;
+    keyring->allocated = bitmap;
+    keyring->capacity = capacity;
+  }
+
+  region = sodium_malloc(slots * HYPERCORE_CRYPTO_KEYRING_SLOT_BYTES);
+  require(0 != region, ENOMEM);
+
+  sodium_memzero(region, slots * HYPERCORE_CRYPTO_KEYRING_SLOT_BYTES);
+  keyring->regions[keyring->length++] = region;
+
+  // push in reverse so lower slots are handed out first
+  for (unsigned long int i = slots; i > 0; --i) {
+    keyring->free[keyring->free_length++] = length * slots + i - 1;
+  }
+
+  return 0;
+}
+
+int
+hypercore_crypto_keyring_init(
+  hypercore_crypto_keyring_t *keyring,
+  hypercore_crypto_keyring_options_t options
+) {
+  INIT_STATE();
+
+  require(0 != keyring, EFAULT);
+
+  if (0 == options.region_slots) {
+    options.region_slots = HYPERCORE_CRYPTO_KEYRING_REGION_SLOTS;
+  }
+
+  memset(keyring, 0, sizeof(*keyring));
+  keyring->region_slots = options.region_slots;
+  return 0;
+}
+
+void
+hypercore_crypto_keyring_destroy(hypercore_crypto_keyring_t *keyring) {
+  if (0 != keyring) {
+    for (unsigned long int i = 0; i < keyring->length; ++i) {
+      // `sodium_free()` zeroes the region before unmapping it
+      sodium_mprotect_readwrite(keyring->regions[i]);
+      sodium_free(keyring->regions[i]);
+    }
+
+    hypercore_crypto_free(keyring->regions);
+    hypercore_crypto_free(keyring->free);
+    hypercore_crypto_free(keyring->allocated);
+    memset(keyring, 0, sizeof(*keyring));
+  }
+}
+
+long int
+hypercore_crypto_keyring_alloc(
+  hypercore_crypto_keyring_t *keyring,
+  hypercore_crypto_buffer_t *secret_key
+) {
+  require(0 != keyring, EFAULT);
+  require(0 != secret_key, EFAULT);
+  require(keyring->region_slots > 0, EINVAL);
+
+  if (0 == keyring->free_length) {
+    int rc = grow(keyring);
+    if (0 != rc) {
+      return rc;
+    }
+  }
+
+  long int slot = keyring->free[--keyring->free_length];
+
+  keyring->allocated[slot / 8] |= 1 << (slot % 8);
+
+  secret_key->bytes = hypercore_crypto_keyring_slot(keyring, slot);
+  secret_key->size = HYPERCORE_CRYPTO_KEYRING_SLOT_BYTES;
+
+  return slot;
+}
+
+int
+hypercore_crypto_keyring_free(
+  hypercore_crypto_keyring_t *keyring,
+  long int slot
+) {
+  require(0 != keyring, EFAULT);
+
+  unsigned char *bytes = hypercore_crypto_keyring_slot(keyring, slot);
+
+  require(0 != bytes, EINVAL);
+
+  // a slot is only returned once, or `free` would outgrow its capacity
+  require(allocated(keyring, slot), EINVAL);
+
+  sodium_memzero(bytes, HYPERCORE_CRYPTO_KEYRING_SLOT_BYTES);
+  keyring->allocated[slot / 8] &= ~(1 << (slot % 8));
+  keyring->free[keyring->free_length++] = slot;
+  return 0;
+}
+
+unsigned char *
+hypercore_crypto_keyring_slot(
+  const hypercore_crypto_keyring_t *keyring,
+  long int slot
+) {
+  if (0 == keyring || slot < 0) {
+    return 0;
+  }
+
+  unsigned long int region = slot / keyring->region_slots;
+  unsigned long int offset = slot % keyring->region_slots;
+
+  if (region >= keyring->length) {
+    return 0;
+  }
+
+  return keyring->regions[region] + offset * HYPERCORE_CRYPTO_KEYRING_SLOT_BYTES;
+}
+
+long int
+hypercore_crypto_keyring_keypair(
+  hypercore_crypto_keyring_t *keyring,
+  hypercore_crypto_keypair_t *keypair,
+  const unsigned char *seed
+) {
+  require(0 != keypair, EFAULT);
+
+  long int slot = hypercore_crypto_keyring_alloc(keyring, &keypair->secret_key);
+  int rc = 0;
+
+  if (slot < 0) {
+    return slot;
+  }
+
+  rc = hypercore_crypto_keypair(keypair, seed);
+
+  if (0 != rc) {
+    hypercore_crypto_keyring_free(keyring, slot);
+    keypair->secret_key.bytes = 0;
+    keypair->secret_key.size = 0;
+    return rc;
+  }
+
+  return slot;
+}
+
+int
+hypercore_crypto_keyring_protect(
+  hypercore_crypto_keyring_t *keyring,
+  long int slot,
+  enum hypercore_crypto_keyring_protection protection
+) {
+  require(0 != keyring, EFAULT);
+
+  unsigned long int begin = 0;
+  unsigned long int end = keyring->length;
+
+  if (slot >= 0) {
+    begin = slot / keyring->region_slots;
+    end = begin + 1;
+    require(begin < keyring->length, EINVAL);
+  }
+
+  for (unsigned long int i = begin; i < end; ++i) {
+    int rc = 0;
+
+    switch (protection) {
+      case HYPERCORE_CRYPTO_KEYRING_NOACCESS:
+        rc = sodium_mprotect_noaccess(keyring->regions[i]);
+        break;
+
+      case HYPERCORE_CRYPTO_KEYRING_READONLY:
+        rc = sodium_mprotect_readonly(keyring->regions[i]);
+        break;
+
+      case HYPERCORE_CRYPTO_KEYRING_READWRITE:
+        rc = sodium_mprotect_readwrite(keyring->regions[i]);
+        break;
+
+      default:
+        require(0, EINVAL);
+    }
+
+    if (0 != rc) {
+      return rc;
+    }
+  }
+
+  return 0;
+}
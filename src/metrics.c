@@ -0,0 +1,214 @@
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "hypercore/crypto/metrics.h"
+
+#include "metrics.h"
+#include "require.h"
+
+// linear sub buckets per power of two
+#define SUB_BITS 3
+#define SUB_BUCKETS (1 << SUB_BITS)
+
+#ifdef HYPERCORE_CRYPTO_METRICS
+
+/**
+ * Counters owned by one thread. Only the owner writes them, other
+ * threads read them while taking a snapshot.
+ */
+struct shard {
+  hypercore_crypto_metrics_t metrics;
+  int registered;
+  struct shard *next;
+};
+
+static HYPERCORE_CRYPTO_THREAD_LOCAL struct shard shard;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static struct shard *shards = 0;
+
+// counters of threads that have exited
+static hypercore_crypto_metrics_t retired;
+
+#define load(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define store(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static void
+add(hypercore_crypto_metrics_t *out, hypercore_crypto_metrics_t *metrics) {
+  for (int i = 0; i < HYPERCORE_CRYPTO_METRICS_OPS; ++i) {
+    hypercore_crypto_metrics_counter_t *target = &out->ops[i];
+    hypercore_crypto_metrics_counter_t *counter = &metrics->ops[i];
+
+    target->calls += load(counter->calls);
+    target->failures += load(counter->failures);
+    target->bytes += load(counter->bytes);
+    target->nanoseconds += load(counter->nanoseconds);
+
+    for (int j = 0; j < HYPERCORE_CRYPTO_METRICS_BUCKETS; ++j) {
+      target->histogram[j] += load(counter->histogram[j]);
+    }
+  }
+}
+
+static void
+retire(void *ptr) {
+  struct shard *local = ptr;
+
+  pthread_mutex_lock(&mutex);
+  add(&retired, &local->metrics);
+
+  for (struct shard **link = &shards; 0 != *link; link = &(*link)->next) {
+    if (local == *link) {
+      *link = local->next;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&mutex);
+  memset(local, 0, sizeof(*local));
+}
+
+static void
+init() {
+  pthread_key_create(&key, retire);
+}
+
+unsigned long long
+hypercore_crypto_metrics_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+int
+hypercore_crypto_metrics_record(
+  hypercore_crypto_metrics_op_t op,
+  unsigned long long bytes,
+  unsigned long long start,
+  int rc
+) {
+  unsigned long long elapsed = hypercore_crypto_metrics_now() - start;
+
+  if (0 == shard.registered) {
+    pthread_once(&once, init);
+    pthread_mutex_lock(&mutex);
+    shard.registered = 1;
+    shard.next = shards;
+    shards = &shard;
+    pthread_mutex_unlock(&mutex);
+    pthread_setspecific(key, &shard);
+  }
+
+  hypercore_crypto_metrics_counter_t *counter = &shard.metrics.ops[op];
+  unsigned long int index = hypercore_crypto_metrics_bucket_index(elapsed);
+
+  store(counter->calls, counter->calls + 1);
+  store(counter->bytes, counter->bytes + bytes);
+  store(counter->nanoseconds, counter->nanoseconds + elapsed);
+  store(counter->histogram[index], counter->histogram[index] + 1);
+
+  if (rc < 0) {
+    store(counter->failures, counter->failures + 1);
+  }
+
+  return rc;
+}
+
+int
+hypercore_crypto_metrics_snapshot(hypercore_crypto_metrics_t *metrics) {
+  require(0 != metrics, EFAULT);
+
+  memset(metrics, 0, sizeof(*metrics));
+  pthread_mutex_lock(&mutex);
+  add(metrics, &retired);
+
+  for (struct shard *local = shards; 0 != local; local = local->next) {
+    add(metrics, &local->metrics);
+  }
+
+  pthread_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+#else
+
+int
+hypercore_crypto_metrics_snapshot(hypercore_crypto_metrics_t *metrics) {
+  require(0 != metrics, EFAULT);
+  memset(metrics, 0, sizeof(*metrics));
+  errno = ENOTSUP;
+  return -errno;
+}
+
+#endif
+
+unsigned long int
+hypercore_crypto_metrics_bucket_index(unsigned long long value) {
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+
+  unsigned long int exponent = 63 - __builtin_clzll(value);
+  unsigned long int mantissa = (value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+  unsigned long int index = (exponent - SUB_BITS + 1) * SUB_BUCKETS + mantissa;
+
+  return index < HYPERCORE_CRYPTO_METRICS_BUCKETS
+    ? index
+    : HYPERCORE_CRYPTO_METRICS_BUCKETS - 1;
+}
+
+unsigned long long
+hypercore_crypto_metrics_bucket(unsigned long int index) {
+  if (index + 1 < SUB_BUCKETS) {
+    return index;
+  } else if (index + 1 >= HYPERCORE_CRYPTO_METRICS_BUCKETS) {
+    return (unsigned long long) -1;
+  }
+
+  // one below the smallest value of the next bucket
+  unsigned long int next = index + 1;
+  unsigned long int exponent = next / SUB_BUCKETS + SUB_BITS - 1;
+  unsigned long long mantissa = SUB_BUCKETS + next % SUB_BUCKETS;
+
+  return (mantissa << (exponent - SUB_BITS)) - 1;
+}
+
+unsigned long long
+hypercore_crypto_metrics_percentile(
+  const hypercore_crypto_metrics_counter_t *counter,
+  double quantile
+) {
+  unsigned long long total = 0;
+  unsigned long long rank = 0;
+
+  if (0 == counter || 0 == counter->calls) {
+    return 0;
+  }
+
+  if (quantile < 0) {
+    quantile = 0;
+  } else if (quantile > 1) {
+    quantile = 1;
+  }
+
+  rank = (unsigned long long) (quantile * counter->calls + 0.5);
+
+  if (0 == rank) {
+    rank = 1;
+  }
+
+  for (unsigned long int i = 0; i < HYPERCORE_CRYPTO_METRICS_BUCKETS; ++i) {
+    total += counter->histogram[i];
+
+    if (total >= rank) {
+      return hypercore_crypto_metrics_bucket(i);
+    }
+  }
+
+  return hypercore_crypto_metrics_bucket(HYPERCORE_CRYPTO_METRICS_BUCKETS - 1);
+}
@@ -0,0 +1,35 @@
+#ifndef _HYPERCORE_CRYPTO_METRICS_H
+#define _HYPERCORE_CRYPTO_METRICS_H
+
+#include "hypercore/crypto/metrics.h"
+
+#ifdef HYPERCORE_CRYPTO_METRICS
+
+#define METRICS_START() \
+  unsigned long long metrics_start = hypercore_crypto_metrics_now()
+
+#define METRICS_END(op, bytes, rc) \
+  hypercore_crypto_metrics_record(op, bytes, metrics_start, rc)
+
+unsigned long long
+hypercore_crypto_metrics_now();
+
+/**
+ * Counts a call of `op` that started at `start` into the calling
+ * thread's counters and returns `rc`.
+ */
+int
+hypercore_crypto_metrics_record(
+  hypercore_crypto_metrics_op_t op,
+  unsigned long long bytes,
+  unsigned long long start,
+  int rc);
+
+#else
+
+#define METRICS_START()
+#define METRICS_END(op, bytes, rc) (rc)
+
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+#include <sodium.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hypercore/crypto/allocator.h"
+#include "hypercore/crypto/crypto.h"
+#include "hypercore/crypto/pool.h"
+
+#include "require.h"
+#include "state.h"
+
+#define SLOT_BYTES (crypto_sign_PUBLICKEYBYTES + crypto_sign_SECRETKEYBYTES)
+
+static void *
+run(void *arg) {
+  hypercore_crypto_keypair_pool_t *pool = arg;
+  unsigned char public_key[crypto_sign_PUBLICKEYBYTES];
+  unsigned char secret_key[crypto_sign_SECRETKEYBYTES];
+
+  sodium_mlock(secret_key, sizeof(secret_key));
+  pthread_mutex_lock(&pool->mutex);
+
+  while (pool->running) {
+    if (pool->length > pool->watermark) {
+      pthread_cond_wait(&pool->refill, &pool->mutex);
+      continue;
+    }
+
+    // fill to capacity, generating keys outside of the lock
+    while (pool->running && pool->length < pool->capacity) {
+      pthread_mutex_unlock(&pool->mutex);
+      int rc = crypto_sign_keypair(public_key, secret_key);
+      pthread_mutex_lock(&pool->mutex);
+
+      if (0 != rc) {
+        break;
+      }
+
+      if (pool->length < pool->capacity) {
+        unsigned long int tail = (pool->head + pool->length) % pool->capacity;
+        unsigned char *slot = pool->keys + tail * SLOT_BYTES;
+        memcpy(slot, public_key, sizeof(public_key));
+        memcpy(slot + sizeof(public_key), secret_key, sizeof(secret_key));
+        (void) pool->length++;
+      }
+    }
+
+    if (pool->running && pool->length <= pool->watermark) {
+      // generation failed, wait to be woken again
+      pthread_cond_wait(&pool->refill, &pool->mutex);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+  sodium_munlock(secret_key, sizeof(secret_key));
+  return 0;
+}
+
+int
+hypercore_crypto_keypair_pool_init(
+  hypercore_crypto_keypair_pool_t *pool,
+  hypercore_crypto_keypair_pool_options_t options
+) {
+  INIT_STATE();
+
+  require(0 != pool, EFAULT);
+
+  if (0 == options.capacity) {
+    options.capacity = HYPERCORE_CRYPTO_KEYPAIR_POOL_CAPACITY;
+  }
+
+  if (0 == options.watermark || options.watermark >= options.capacity) {
+    options.watermark = options.capacity / 2;
+  }
+
+  memset(pool, 0, sizeof(*pool));
+  pool->capacity = options.capacity;
+  pool->watermark = options.watermark;
+  pool->keys = sodium_malloc(pool->capacity * SLOT_BYTES);
+
+  require(0 != pool->keys, ENOMEM);
+
+  pthread_mutex_init(&pool->mutex, 0);
+  pthread_cond_init(&pool->refill, 0);
+  pool->running = 1;
+
+  if (0 != pthread_create(&pool->thread, 0, run, pool)) {
+    pool->running = 0;
+    pthread_cond_destroy(&pool->refill);
+    pthread_mutex_destroy(&pool->mutex);
+    sodium_free(pool->keys);
+    pool->keys = 0;
+    require(0, EAGAIN);
+  }
+
+  return 0;
+}
+
+void
+hypercore_crypto_keypair_pool_destroy(hypercore_crypto_keypair_pool_t *pool) {
+  if (0 != pool && 0 != pool->keys) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->running = 0;
+    pthread_cond_signal(&pool->refill);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_join(pool->thread, 0);
+    pthread_cond_destroy(&pool->refill);
+    pthread_mutex_destroy(&pool->mutex);
+
+    // `sodium_free()` zeroes the region before unmapping it
+    sodium_free(pool->keys);
+    memset(pool, 0, sizeof(*pool));
+  }
+}
+
+int
+hypercore_crypto_keypair_pool_pop(
+  hypercore_crypto_keypair_pool_t *pool,
+  hypercore_crypto_keypair_t *kp
+) {
+  INIT_STATE();
+
+  int allocs = 0;
+  int popped = 0;
+
+  require(0 != pool, EFAULT);
+  require(0 != kp, EFAULT);
+  require(0 != pool->keys, EINVAL);
+
+  if (0 == kp->public_key.bytes) {
+    kp->public_key.bytes = hypercore_crypto_alloc(crypto_sign_PUBLICKEYBYTES);
+
+    require(0 != kp->public_key.bytes, ENOMEM);
+    kp->public_key.size = crypto_sign_PUBLICKEYBYTES;
+    (void) allocs++;
+  }
+
+  if (0 == kp->secret_key.bytes) {
+    kp->secret_key.bytes = sodium_malloc(crypto_sign_SECRETKEYBYTES);
+
+    if (0 == kp->secret_key.bytes && allocs > 0) {
+      hypercore_crypto_free(kp->public_key.bytes);
+      kp->public_key.bytes = 0;
+      kp->public_key.size = 0;
+    }
+
+    require(0 != kp->secret_key.bytes, ENOMEM);
+    kp->secret_key.size = crypto_sign_SECRETKEYBYTES;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+
+  if (pool->length > 0) {
+    unsigned char *slot = pool->keys + pool->head * SLOT_BYTES;
+
+    memcpy(kp->public_key.bytes, slot, crypto_sign_PUBLICKEYBYTES);
+    memcpy(
+      kp->secret_key.bytes,
+      slot + crypto_sign_PUBLICKEYBYTES,
+      crypto_sign_SECRETKEYBYTES);
+
+    sodium_memzero(slot, SLOT_BYTES);
+    pool->head = (pool->head + 1) % pool->capacity;
+    (void) pool->length--;
+    popped = 1;
+  }
+
+  if (pool->length <= pool->watermark) {
+    pthread_cond_signal(&pool->refill);
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (0 == popped) {
+    return hypercore_crypto_keypair(kp, 0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _HYPERCORE_CRYPTO_PROBES_H
+#define _HYPERCORE_CRYPTO_PROBES_H
+
+/**
+ * USDT probes under the `hypercore_crypto` provider, for example
+ * `bpftrace -e 'usdt:./libhypercore-crypto.so:hypercore_crypto:verify__return { ... }'`.
+ * A probe site is a single `nop` until a tracer attaches. Probes compile
+ * to nothing without `sys/sdt.h` or with `HYPERCORE_CRYPTO_NO_PROBES`.
+ */
+#if defined(HYPERCORE_CRYPTO_HAVE_SYS_SDT_H) && !defined(HYPERCORE_CRYPTO_NO_PROBES)
+
+#include <sys/sdt.h>
+
+#define HYPERCORE_CRYPTO_PROBES 1
+
+#define PROBE1(name, a) \
+  DTRACE_PROBE1(hypercore_crypto, name, a)
+
+#define PROBE2(name, a, b) \
+  DTRACE_PROBE2(hypercore_crypto, name, a, b)
+
+#define PROBE3(name, a, b, c) \
+  DTRACE_PROBE3(hypercore_crypto, name, a, b, c)
+
+#else
+
+#define PROBE1(name, a) ((void) 0)
+#define PROBE2(name, a, b) ((void) 0)
+#define PROBE3(name, a, b, c) ((void) 0)
+
+#endif
+
+#endif
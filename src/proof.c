@@ -0,0 +1,320 @@
+#include <flat-tree/flat-tree.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hypercore/crypto/crypto.h"
+#include "hypercore/crypto/proof.h"
+
+#include "require.h"
+
+struct entry {
+  unsigned long long index;
+  unsigned long long size;
+  unsigned char hash[hypercore_crypto_data_BYTES];
+};
+
+// first and last block under flat tree `index`
+static void
+blocks_of(
+  unsigned long long index,
+  unsigned long long *first,
+  unsigned long long *last
+) {
+  unsigned long long half = ((index + 1) & ~index) - 1;
+  *first = (index - half) / 2;
+  *last = (index + half) / 2;
+}
+
+static int
+valid(
+  const unsigned long long *ranges,
+  unsigned long long count,
+  unsigned long long length
+) {
+  for (unsigned long long i = 0; i < count; ++i) {
+    unsigned long long start = ranges[2 * i];
+    unsigned long long end = ranges[2 * i + 1];
+
+    if (start >= end || end > length) {
+      return 0;
+    }
+
+    if (i > 0 && start < ranges[2 * i - 1]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// requested blocks in `first` to `last`
+static unsigned long long
+covered(
+  const unsigned long long *ranges,
+  unsigned long long count,
+  unsigned long long first,
+  unsigned long long last
+) {
+  unsigned long long blocks = 0;
+
+  for (unsigned long long i = 0; i < count; ++i) {
+    unsigned long long start = ranges[2 * i] > first ? ranges[2 * i] : first;
+    unsigned long long end = ranges[2 * i + 1] < last + 1 ? ranges[2 * i + 1] : last + 1;
+
+    if (start < end) {
+      blocks += end - start;
+    }
+  }
+
+  return blocks;
+}
+
+static void
+collect(
+  unsigned long long index,
+  const unsigned long long *ranges,
+  unsigned long long count,
+  unsigned long long *indices,
+  unsigned long long capacity,
+  unsigned long long *nodes
+) {
+  unsigned long long first = 0;
+  unsigned long long last = 0;
+  unsigned long long blocks = 0;
+
+  blocks_of(index, &first, &last);
+  blocks = covered(ranges, count, first, last);
+
+  // nothing below can be hashed from the request, so the node is sent
+  if (0 == blocks) {
+    if (*nodes < capacity) {
+      indices[*nodes] = index;
+    }
+
+    (*nodes)++;
+    return;
+  }
+
+  // everything below is hashed from the request
+  if (last - first + 1 == blocks) {
+    return;
+  }
+
+  unsigned long long half = ((index + 1) & ~index) >> 1;
+
+  collect(index - half, ranges, count, indices, capacity, nodes);
+  collect(index + half, ranges, count, indices, capacity, nodes);
+}
+
+int
+hypercore_crypto_proof_nodes(
+  unsigned long long length,
+  const unsigned long long *ranges,
+  unsigned long long count,
+  unsigned long long *indices,
+  unsigned long long *nodes
+) {
+  unsigned long long capacity = 0;
+  unsigned long long start = 0;
+
+  require(0 != ranges || 0 == count, EFAULT);
+  require(0 != nodes, EFAULT);
+  require(0 != indices || 0 == *nodes, EFAULT);
+  require(valid(ranges, count, length), EINVAL);
+
+  capacity = *nodes;
+  *nodes = 0;
+
+  // one full subtree per set bit of `length`, largest first
+  for (int bit = 63; bit >= 0; --bit) {
+    unsigned long long width = 1ULL << bit;
+
+    if (0 == (length & width)) {
+      continue;
+    }
+
+    // roots are signed, only roots over requested blocks need nodes
+    if (covered(ranges, count, start, start + width - 1) > 0) {
+      collect(2 * start + width - 1, ranges, count, indices, capacity, nodes);
+    }
+
+    start += width;
+  }
+
+  require(*nodes <= capacity, ERANGE);
+
+  return 0;
+}
+
+// first leaf under flat tree `index`, the order nodes are hashed in
+static unsigned long long
+left_span(unsigned long long index) {
+  return index - (((index + 1) & ~index) - 1);
+}
+
+static int
+merge(struct entry *left, const struct entry *right) {
+  unsigned char bytes[hypercore_crypto_data_BYTES];
+  hypercore_crypto_buffer_t hash = { sizeof(bytes), bytes };
+  hypercore_crypto_buffer_t left_hash = { sizeof(left->hash), left->hash };
+  hypercore_crypto_buffer_t right_hash = { sizeof(right->hash), (unsigned char *) right->hash };
+  hypercore_crypto_node_t left_node = {
+    .index = left->index,
+    .size = left->size,
+    .hash = &left_hash
+  };
+
+  hypercore_crypto_node_t right_node = {
+    .index = right->index,
+    .size = right->size,
+    .hash = &right_hash
+  };
+
+  int rc = hypercore_crypto_parent(&hash, &left_node, &right_node);
+
+  if (0 != rc) {
+    return rc;
+  }
+
+  memcpy(left->hash, bytes, sizeof(bytes));
+  left->index = ft_parent(left->index, 0);
+  left->size += right->size;
+
+  return 0;
+}
+
+static const hypercore_crypto_node_t *
+root_of(
+  const struct entry *entry,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count
+) {
+  for (unsigned long long i = 0; i < count; ++i) {
+    if (0 != roots[i] && entry->index == roots[i]->index) {
+      return roots[i];
+    }
+  }
+
+  return 0;
+}
+
+int
+hypercore_crypto_proof_verify(
+  const unsigned long long *ranges,
+  unsigned long long count,
+  const hypercore_crypto_buffer_t *blocks,
+  const hypercore_crypto_node_t **nodes,
+  unsigned long long nodes_count,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long roots_count,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *public_key
+) {
+  struct entry stack[HYPERCORE_CRYPTO_PROOF_MAX_DEPTH + 1];
+  unsigned long long depth = 0;
+  unsigned long long range = 0;
+  unsigned long long block = 0;
+  unsigned long long node = 0;
+  unsigned long long b = 0;
+  int rc = 0;
+
+  require(0 != ranges && count > 0, EFAULT);
+  require(0 != blocks, EFAULT);
+  require(0 != nodes || 0 == nodes_count, EFAULT);
+  require(0 != roots && roots_count > 0, EFAULT);
+  require(valid(ranges, count, (unsigned long long) -1), EINVAL);
+
+  block = ranges[0];
+
+  while (range < count || node < nodes_count) {
+    const hypercore_crypto_node_t *next = node < nodes_count ? nodes[node] : 0;
+    struct entry *entry = 0;
+
+    require(0 != next || node == nodes_count, EFAULT);
+    require(depth <= HYPERCORE_CRYPTO_PROOF_MAX_DEPTH, ERANGE);
+
+    entry = &stack[depth++];
+
+    // blocks and nodes are hashed in the order they appear in the tree
+    if (range < count && (0 == next || 2 * block < left_span(next->index))) {
+      hypercore_crypto_buffer_t hash = { sizeof(entry->hash), entry->hash };
+
+      rc = hypercore_crypto_data(&hash, &blocks[b]);
+
+      if (0 != rc) {
+        return rc;
+      }
+
+      entry->index = 2 * block;
+      entry->size = blocks[b].size;
+
+      b++;
+
+      if (++block == ranges[2 * range + 1] && ++range < count) {
+        block = ranges[2 * range];
+      }
+    } else {
+      require(0 != next->hash && 0 != next->hash->bytes, EFAULT);
+      require(sizeof(entry->hash) == next->hash->size, EINVAL);
+
+      memcpy(entry->hash, next->hash->bytes, sizeof(entry->hash));
+      entry->index = next->index;
+      entry->size = next->size;
+
+      node++;
+    }
+
+    while (depth > 0) {
+      struct entry *top = &stack[depth - 1];
+      const hypercore_crypto_node_t *root = root_of(top, roots, roots_count);
+
+      if (0 != root) {
+        if (
+          0 == root->hash ||
+          0 == root->hash->bytes ||
+          sizeof(top->hash) != root->hash->size ||
+          top->size != root->size ||
+          0 != memcmp(top->hash, root->hash->bytes, sizeof(top->hash))
+        ) {
+          return -1;
+        }
+
+        depth--;
+        break;
+      }
+
+      // a left sibling waiting below is hashed with the node on top
+      if (
+        depth < 2 ||
+        stack[depth - 2].index > top->index ||
+        stack[depth - 2].index != ft_sibling(top->index, 0)
+      ) {
+        break;
+      }
+
+      rc = merge(&stack[depth - 2], top);
+
+      if (0 != rc) {
+        return rc;
+      }
+
+      depth--;
+    }
+  }
+
+  // a node left over did not hash up to a root
+  if (depth > 0) {
+    return -1;
+  }
+
+  unsigned char bytes[hypercore_crypto_data_BYTES];
+  hypercore_crypto_buffer_t hash = { sizeof(bytes), bytes };
+
+  rc = hypercore_crypto_tree(&hash, roots, roots_count);
+
+  if (0 != rc) {
+    return rc;
+  }
+
+  return hypercore_crypto_verify(signature, &hash, public_key);
+}
@@ -0,0 +1,133 @@
+#include <sodium.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "hypercore/crypto/crypto.h"
+
+#include "random.h"
+
+// bytes of keystream produced per refill
+#ifndef HYPERCORE_CRYPTO_RANDOMBYTES_POOL_BYTES
+#define HYPERCORE_CRYPTO_RANDOMBYTES_POOL_BYTES 1024
+#endif
+
+// requests larger than this bypass the pool
+#ifndef HYPERCORE_CRYPTO_RANDOMBYTES_POOL_MAX
+#define HYPERCORE_CRYPTO_RANDOMBYTES_POOL_MAX 256
+#endif
+
+// refills before the key is mixed with fresh system entropy
+#ifndef HYPERCORE_CRYPTO_RANDOMBYTES_POOL_RESEED
+#define HYPERCORE_CRYPTO_RANDOMBYTES_POOL_RESEED 1024
+#endif
+
+struct pool {
+  unsigned char key[crypto_stream_chacha20_KEYBYTES];
+  unsigned char buffer[HYPERCORE_CRYPTO_RANDOMBYTES_POOL_BYTES];
+  unsigned long int offset;
+  unsigned long int refills;
+  unsigned long int generation;
+  int seeded;
+};
+
+#define load(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define store(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static HYPERCORE_CRYPTO_THREAD_LOCAL struct pool pool = { { 0 } };
+
+// set from any thread and read on every fill, so accessed atomically
+static int enabled = 0;
+
+// bumped in a forked child so inherited pools are reseeded
+static unsigned long int generation = 0;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static void
+atfork_child() {
+  store(generation, load(generation) + 1);
+}
+
+static void
+destroy(void *ptr) {
+  sodium_memzero(ptr, sizeof(struct pool));
+}
+
+static void
+init() {
+  pthread_atfork(0, 0, atfork_child);
+  pthread_key_create(&key, destroy);
+}
+
+static void
+seed() {
+  unsigned char entropy[crypto_stream_chacha20_KEYBYTES];
+
+  if (0 == pool.seeded) {
+    pthread_once(&once, init);
+    pthread_setspecific(key, &pool);
+    randombytes_buf(pool.key, sizeof(pool.key));
+  } else {
+    // mix fresh entropy into the current key
+    randombytes_buf(entropy, sizeof(entropy));
+    for (unsigned long int i = 0; i < sizeof(entropy); ++i) {
+      pool.key[i] ^= entropy[i];
+    }
+
+    sodium_memzero(entropy, sizeof(entropy));
+  }
+
+  pool.seeded = 1;
+  pool.refills = 0;
+  pool.generation = load(generation);
+  pool.offset = sizeof(pool.buffer);
+}
+
+static void
+refill() {
+  static const unsigned char nonce[crypto_stream_chacha20_NONCEBYTES] = { 0 };
+  unsigned char stream[sizeof(pool.key) + sizeof(pool.buffer)];
+
+  if (
+    0 == pool.seeded ||
+    load(generation) != pool.generation ||
+    pool.refills >= HYPERCORE_CRYPTO_RANDOMBYTES_POOL_RESEED
+  ) {
+    seed();
+  }
+
+  // the first block of keystream replaces the key so output that was
+  // already handed out can not be reconstructed from the pool state
+  crypto_stream_chacha20(stream, sizeof(stream), nonce, pool.key);
+  memcpy(pool.key, stream, sizeof(pool.key));
+  memcpy(pool.buffer, stream + sizeof(pool.key), sizeof(pool.buffer));
+  sodium_memzero(stream, sizeof(stream));
+
+  pool.offset = 0;
+  (void) pool.refills++;
+}
+
+void
+hypercore_crypto_randombytes_pool_set(int enable) {
+  store(enabled, 0 != enable);
+}
+
+void
+hypercore_crypto_randombytes_fill(unsigned char *out, unsigned long int size) {
+  if (0 == load(enabled) || size > HYPERCORE_CRYPTO_RANDOMBYTES_POOL_MAX) {
+    randombytes_buf(out, size);
+    return;
+  }
+
+  if (
+    0 == pool.seeded ||
+    load(generation) != pool.generation ||
+    size > sizeof(pool.buffer) - pool.offset
+  ) {
+    refill();
+  }
+
+  memcpy(out, pool.buffer + pool.offset, size);
+  sodium_memzero(pool.buffer + pool.offset, size);
+  pool.offset += size;
+}
@@ -0,0 +1,12 @@
+#ifndef _HYPERCORE_CRYPTO_RANDOM_H
+#define _HYPERCORE_CRYPTO_RANDOM_H
+
+/**
+ * Fills `out` from the calling thread's buffered generator when enabled
+ * with `hypercore_crypto_randombytes_pool_set()`, otherwise directly
+ * from `randombytes_buf()`.
+ */
+void
+hypercore_crypto_randombytes_fill(unsigned char *out, unsigned long int size);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _HYPERCORE_CRYPTO_STATE_H
+#define _HYPERCORE_CRYPTO_STATE_H
+
+#define INIT_STATE() {                    \
+  int rc = hypercore_crypto_init_state(); \
+  if (0 != rc) { return rc; }             \
+}
+
+int
+hypercore_crypto_init_state();
+
+/**
+ * Sets the allocator used when none was set with
+ * `hypercore_crypto_allocator_set()` and no scope is active.
+ */
+void
+hypercore_crypto_allocator_default(
+  void *(*allocator)(unsigned long int),
+  void (*deallocator)(void *));
+
+#endif
@@ -0,0 +1,232 @@
+#include <uint64be/uint64be.h>
+#include <sodium.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hypercore/crypto/allocator.h"
+#include "hypercore/crypto/tree.h"
+
+#include "metrics.h"
+#include "probes.h"
+#include "require.h"
+#include "state.h"
+
+#define ROOT_BYTES HYPERCORE_CRYPTO_TREE_HASH_ROOT_BYTES
+
+// first and last flat tree index spanned by `index`
+static void
+span(unsigned long long index, unsigned long long *first, unsigned long long *last) {
+  unsigned long long half = ((index + 1) & ~index) - 1;
+  *first = index - half;
+  *last = index + half;
+}
+
+static int
+encode(
+  hypercore_crypto_tree_hash_t *tree,
+  unsigned long long position,
+  const hypercore_crypto_node_t *node
+) {
+  unsigned char *bytes = tree->encoded + 1 + position * ROOT_BYTES;
+
+  require(0 != node, EFAULT);
+  require(0 != node->hash && 0 != node->hash->bytes, EFAULT);
+  require(32 == node->hash->size, EINVAL);
+  require(position < HYPERCORE_CRYPTO_TREE_HASH_MAX_ROOTS, ERANGE);
+
+  memcpy(bytes, node->hash->bytes, 32);
+  memset(bytes + 32, 0, 16);
+
+  if (
+    uint64be_encode(bytes + 32, node->index) < 0 ||
+    uint64be_encode(bytes + 40, node->size) < 0
+  ) {
+    return -1;
+  }
+
+  tree->indices[position] = node->index;
+  tree->sizes[position] = node->size;
+
+  return 0;
+}
+
+void
+hypercore_crypto_tree_hash_init(hypercore_crypto_tree_hash_t *tree) {
+  if (0 != tree) {
+    tree->count = 0;
+    tree->encoded[0] = HYPERCORE_CRYPTO_ROOT_BYTE;
+  }
+}
+
+int
+hypercore_crypto_tree_hash_append(
+  hypercore_crypto_tree_hash_t *tree,
+  const hypercore_crypto_node_t *node
+) {
+  unsigned long long first = 0;
+  unsigned long long last = 0;
+  int rc = 0;
+
+  require(0 != tree, EFAULT);
+  require(0 != node, EFAULT);
+
+  span(node->index, &first, &last);
+
+  // a parent replaces the roots under it, its children
+  while (tree->count > 0) {
+    unsigned long long index = tree->indices[tree->count - 1];
+
+    if (index < first || index > last) {
+      break;
+    }
+
+    tree->count--;
+  }
+
+  rc = encode(tree, tree->count, node);
+
+  if (0 == rc) {
+    tree->count++;
+  }
+
+  return rc;
+}
+
+int
+hypercore_crypto_tree_hash_update(
+  hypercore_crypto_tree_hash_t *tree,
+  const hypercore_crypto_node_t **roots,
+  unsigned long long count
+) {
+  unsigned long long i = 0;
+
+  require(0 != tree, EFAULT);
+  require(0 != roots || 0 == count, EFAULT);
+  require(count <= HYPERCORE_CRYPTO_TREE_HASH_MAX_ROOTS, ERANGE);
+
+  // roots of another tree, or of a truncated and rewritten one, can
+  // share an index and length, so the hash is compared too
+  while (
+    i < count &&
+    i < tree->count &&
+    0 != roots[i] &&
+    roots[i]->index == tree->indices[i] &&
+    roots[i]->size == tree->sizes[i] &&
+    0 != roots[i]->hash &&
+    0 != roots[i]->hash->bytes &&
+    32 == roots[i]->hash->size &&
+    0 == memcmp(tree->encoded + 1 + i * ROOT_BYTES, roots[i]->hash->bytes, 32)
+  ) {
+    i++;
+  }
+
+  tree->count = i;
+
+  for (; i < count; ++i) {
+    int rc = encode(tree, i, roots[i]);
+
+    if (0 != rc) {
+      return rc;
+    }
+
+    tree->count = i + 1;
+  }
+
+  return 0;
+}
+
+static int
+final(const hypercore_crypto_tree_hash_t *tree, hypercore_crypto_buffer_t *out) {
+  INIT_STATE();
+
+  require(0 != tree, EFAULT);
+  require(0 != out, EFAULT);
+
+  if (0 == out->bytes) {
+    out->bytes = hypercore_crypto_alloc(hypercore_crypto_data_BYTES);
+
+    require(0 != out->bytes, ENOMEM);
+
+    out->size = hypercore_crypto_data_BYTES;
+  }
+
+  return crypto_generichash(
+    out->bytes,
+    out->size,
+    tree->encoded,
+    1 + tree->count * ROOT_BYTES,
+    0,
+    0);
+}
+
+int
+hypercore_crypto_tree_hash_final(
+  const hypercore_crypto_tree_hash_t *tree,
+  hypercore_crypto_buffer_t *out
+) {
+  int rc = 0;
+
+  PROBE1(tree__entry, 0 != tree ? tree->count : 0);
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_TREE,
+    0 != tree ? tree->count * ROOT_BYTES : 0,
+    final(tree, out));
+  PROBE1(tree__return, rc);
+
+  return rc;
+}
+
+static int
+sign(
+  const hypercore_crypto_tree_hash_t *tree,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *secret_key
+) {
+  unsigned char hash[hypercore_crypto_data_BYTES];
+  hypercore_crypto_buffer_t out = { sizeof(hash), hash };
+  int rc = 0;
+
+  require(0 != signature, EFAULT);
+  require(0 != secret_key && 0 != secret_key->bytes, EFAULT);
+
+  rc = final(tree, &out);
+
+  if (0 != rc) {
+    return rc;
+  }
+
+  if (0 == signature->bytes) {
+    signature->bytes = hypercore_crypto_alloc(crypto_sign_BYTES);
+
+    require(0 != signature->bytes, ENOMEM);
+
+    signature->size = crypto_sign_BYTES;
+  }
+
+  return crypto_sign_detached(
+    signature->bytes,
+    &signature->size,
+    hash,
+    sizeof(hash),
+    secret_key->bytes);
+}
+
+int
+hypercore_crypto_tree_hash_sign(
+  const hypercore_crypto_tree_hash_t *tree,
+  hypercore_crypto_buffer_t *signature,
+  const hypercore_crypto_buffer_t *secret_key
+) {
+  int rc = 0;
+
+  PROBE1(sign_roots__entry, 0 != tree ? tree->count : 0);
+  METRICS_START();
+  rc = METRICS_END(
+    HYPERCORE_CRYPTO_METRICS_SIGN_ROOTS,
+    0 != tree ? tree->count * ROOT_BYTES : 0,
+    sign(tree, signature, secret_key));
+  PROBE1(sign_roots__return, rc);
+
+  return rc;
+}
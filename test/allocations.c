@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <merkle/allocator.h>
+#include <merkle/merkle.h>
+#include <ok/ok.h>
+
+#include "hypercore/crypto/crypto.h"
+
+#define bytes(b) (unsigned char *) (b)
+
+/**
+ * Allocation budgets: the number of allocations and frees a call may
+ * make. A call that makes more fails its test, a call that makes fewer
+ * passes and reports that its budget can be lowered.
+ */
+typedef struct snapshot {
+  struct hypercore_crypto_allocator_stats_s crypto;
+  struct merkle_allocator_stats_s merkle;
+} snapshot_t;
+
+static snapshot_t before;
+
+static void
+begin() {
+  before.crypto = hypercore_crypto_allocator_stats();
+  before.merkle = merkle_allocator_stats();
+}
+
+static int
+within(
+  const char *name,
+  unsigned long long allocs,
+  unsigned long long frees,
+  unsigned long long actual_allocs,
+  unsigned long long actual_frees
+) {
+  if (actual_allocs > allocs || actual_frees > frees) {
+    fprintf(stderr,
+      "%s: %llu allocations and %llu frees exceed the budget of %llu and %llu\n",
+      name, actual_allocs, actual_frees, allocs, frees);
+    return 0;
+  }
+
+  if (actual_allocs < allocs || actual_frees < frees) {
+    fprintf(stderr,
+      "%s: %llu allocations and %llu frees, the budget of %llu and %llu can be lowered\n",
+      name, actual_allocs, actual_frees, allocs, frees);
+  }
+
+  return 1;
+}
+
+static int
+budget(const char *name, unsigned long long allocs, unsigned long long frees) {
+  struct hypercore_crypto_allocator_stats_s after = hypercore_crypto_allocator_stats();
+  return within(name, allocs, frees,
+    after.alloc - before.crypto.alloc,
+    after.free - before.crypto.free);
+}
+
+static int
+merkle_budget(const char *name, unsigned long long allocs, unsigned long long frees) {
+  struct merkle_allocator_stats_s after = merkle_allocator_stats();
+  return within(name, allocs, frees,
+    after.alloc + after.realloc - before.merkle.alloc - before.merkle.realloc,
+    after.free - before.merkle.free);
+}
+
+/**
+ * Appends `blocks` blocks to a new tree, releasing the nodes of each
+ * append, then destroys the tree. Reallocations count as allocations
+ * and every block must be freed.
+ */
+static int
+merkle_run(
+  const char *name,
+  unsigned long int blocks,
+  unsigned long long allocs,
+  unsigned long long frees
+) {
+  merkle_t merkle = { 0 };
+
+  begin();
+  merkle_init(&merkle, MERKLE_DEFAULT_OPTIONS);
+
+  for (unsigned long int i = 0; i < blocks; ++i) {
+    merkle_node_list_destroy(merkle_next(&merkle, bytes("hello"), 5, 0));
+  }
+
+  merkle_destroy(&merkle);
+
+  return
+    merkle_budget(name, allocs, frees) &&
+    merkle_allocator_stats().current == before.merkle.current;
+}
+
+static int
+tree_run(const char *name, unsigned long int count, unsigned long long allocs) {
+  unsigned char hashes[64][32];
+  hypercore_crypto_buffer_t buffers[64];
+  hypercore_crypto_node_t nodes[64];
+  const hypercore_crypto_node_t *roots[64];
+  hypercore_crypto_buffer_t out = { 0 };
+
+  for (unsigned long int i = 0; i < count; ++i) {
+    memset(hashes[i], i, 32);
+    buffers[i] = (hypercore_crypto_buffer_t) { 32, hashes[i] };
+    nodes[i] = (hypercore_crypto_node_t) { .index = 2 * i, .size = 5, .hash = &buffers[i] };
+    roots[i] = &nodes[i];
+  }
+
+  begin();
+
+  if (0 != hypercore_crypto_tree(&out, roots, count)) {
+    return 0;
+  }
+
+  hypercore_crypto_free(out.bytes);
+
+  return budget(name, allocs, allocs);
+}
+
+int
+main(void) {
+#ifdef OK_EXPECTED
+  ok_expect(OK_EXPECTED);
+#else
+  ok_expect(0);
+#endif
+
+  struct hypercore_crypto_allocator_stats_s start;
+  hypercore_crypto_keypair_t keypair = { 0 };
+  unsigned char public_key[32];
+  unsigned char secret_key[64];
+  unsigned char signature_bytes[64];
+  unsigned char hash_bytes[32];
+  hypercore_crypto_buffer_t message = { 5, bytes("hello") };
+  hypercore_crypto_buffer_t signature = { 64, signature_bytes };
+  hypercore_crypto_buffer_t hash = { 32, hash_bytes };
+  hypercore_crypto_buffer_t out = { 0 };
+  int rc = 0;
+
+  // initialize the library before counting
+  hypercore_crypto_keypair(&keypair, 0);
+  hypercore_crypto_keypair_destroy(&keypair);
+  start = hypercore_crypto_allocator_stats();
+
+  // the secret key comes from sodium_malloc() and is not counted
+  begin();
+  hypercore_crypto_keypair(&keypair, 0);
+  hypercore_crypto_keypair_destroy(&keypair);
+
+  if (budget("hypercore_crypto_keypair", 1, 1)) {
+    ok("hypercore_crypto_keypair");
+  }
+
+  keypair.public_key = (hypercore_crypto_buffer_t) { 32, public_key };
+  keypair.secret_key = (hypercore_crypto_buffer_t) { 64, secret_key };
+
+  begin();
+  hypercore_crypto_keypair(&keypair, 0);
+
+  if (budget("hypercore_crypto_keypair (caller buffers)", 0, 0)) {
+    ok("hypercore_crypto_keypair (caller buffers)");
+  }
+
+  begin();
+  hypercore_crypto_sign(&out, &message, &keypair.secret_key);
+  hypercore_crypto_free(out.bytes);
+  out = (hypercore_crypto_buffer_t) { 0 };
+  hypercore_crypto_sign(&signature, &message, &keypair.secret_key);
+
+  if (budget("hypercore_crypto_sign", 1, 1)) {
+    ok("hypercore_crypto_sign");
+  }
+
+  begin();
+  hypercore_crypto_verify(&signature, &message, &keypair.public_key);
+
+  if (budget("hypercore_crypto_verify", 0, 0)) {
+    ok("hypercore_crypto_verify");
+  }
+
+  begin();
+  hypercore_crypto_data(&out, &message);
+  hypercore_crypto_free(out.bytes);
+  out = (hypercore_crypto_buffer_t) { 0 };
+  hypercore_crypto_data(&hash, &message);
+
+  if (budget("hypercore_crypto_data", 1, 1)) {
+    ok("hypercore_crypto_data");
+  }
+
+  hypercore_crypto_node_t left = { .index = 0, .size = 5, .hash = &hash };
+  hypercore_crypto_node_t right = { .index = 2, .size = 5, .hash = &hash };
+  hypercore_crypto_buffer_t data = { 5, bytes("hello") };
+  hypercore_crypto_node_t leaf = { .index = 0, .size = 5, .data = &data };
+
+  begin();
+  hypercore_crypto_leaf(&out, &leaf);
+  hypercore_crypto_free(out.bytes);
+  out = (hypercore_crypto_buffer_t) { 0 };
+
+  if (budget("hypercore_crypto_leaf", 1, 1)) {
+    ok("hypercore_crypto_leaf");
+  }
+
+  begin();
+  hypercore_crypto_parent(&out, &left, &right);
+  hypercore_crypto_free(out.bytes);
+  out = (hypercore_crypto_buffer_t) { 0 };
+
+  if (budget("hypercore_crypto_parent", 1, 1)) {
+    ok("hypercore_crypto_parent");
+  }
+
+  // one output buffer regardless of the number of roots
+  if (tree_run("hypercore_crypto_tree (1 root)", 1, 1)) {
+    ok("hypercore_crypto_tree (1 root)");
+  }
+
+  if (tree_run("hypercore_crypto_tree (8 roots)", 8, 1)) {
+    ok("hypercore_crypto_tree (8 roots)");
+  }
+
+  if (tree_run("hypercore_crypto_tree (64 roots)", 64, 1)) {
+    ok("hypercore_crypto_tree (64 roots)");
+  }
+
+  hypercore_crypto_tree_hash_t tree;
+  hypercore_crypto_node_t root = { .index = 0, .size = 5, .hash = &hash };
+
+  // no allocations with a caller buffer
+  begin();
+  hypercore_crypto_tree_hash_init(&tree);
+  hypercore_crypto_tree_hash_append(&tree, &root);
+  hypercore_crypto_tree_hash_final(&tree, &hash);
+
+  if (budget("hypercore_crypto_tree_hash_final", 0, 0)) {
+    ok("hypercore_crypto_tree_hash_final");
+  }
+
+  const hypercore_crypto_node_t *roots[] = { &root };
+
+  begin();
+  hypercore_crypto_sign_roots(&signature, roots, 1, &keypair.secret_key);
+  hypercore_crypto_tree_hash_sign(&tree, &signature, &keypair.secret_key);
+
+  if (budget("hypercore_crypto_sign_roots", 0, 0)) {
+    ok("hypercore_crypto_sign_roots");
+  }
+
+  // a block that is its own root, verified all the way to the signature
+  hypercore_crypto_data(&hash, &message);
+  hypercore_crypto_sign_roots(&signature, roots, 1, &keypair.secret_key);
+
+  begin();
+  rc = hypercore_crypto_verify_block(
+    &message, 0, 0, 0, roots, 1, &signature, &keypair.public_key);
+
+  if (0 == rc && budget("hypercore_crypto_verify_block", 0, 0)) {
+    ok("hypercore_crypto_verify_block");
+  }
+
+  unsigned long long range[] = { 0, 1 };
+
+  begin();
+  rc = hypercore_crypto_proof_verify(
+    range, 1, &message, 0, 0, roots, 1, &signature, &keypair.public_key);
+
+  if (0 == rc && budget("hypercore_crypto_proof_verify", 0, 0)) {
+    ok("hypercore_crypto_proof_verify");
+  }
+
+  begin();
+  hypercore_crypto_discoverykey(&out, &keypair.public_key);
+  hypercore_crypto_free(out.bytes);
+  out = (hypercore_crypto_buffer_t) { 0 };
+  hypercore_crypto_discoverykey(&hash, &keypair.public_key);
+
+  if (budget("hypercore_crypto_discoverykey", 1, 1)) {
+    ok("hypercore_crypto_discoverykey");
+  }
+
+  hypercore_crypto_buffer_t keys[4] = {
+    { 32, public_key }, { 32, public_key }, { 32, public_key }, { 32, public_key }
+  };
+
+  // one contiguous output buffer for every key
+  begin();
+  hypercore_crypto_discoverykey_many(&out, keys, 4);
+  hypercore_crypto_free(out.bytes);
+  out = (hypercore_crypto_buffer_t) { 0 };
+
+  if (budget("hypercore_crypto_discoverykey_many", 1, 1)) {
+    ok("hypercore_crypto_discoverykey_many");
+  }
+
+  hypercore_crypto_keypair_t keypairs[4] = { 0 };
+
+  // one shared region each for public and secret keys, the secret one
+  // from sodium_malloc()
+  begin();
+  hypercore_crypto_keypair_derive_many(secret_key, keys, 4, keypairs);
+  hypercore_crypto_keypair_destroy_many(keypairs, 4);
+
+  if (budget("hypercore_crypto_keypair_derive_many", 1, 1)) {
+    ok("hypercore_crypto_keypair_derive_many");
+  }
+
+  begin();
+  hypercore_crypto_randombytes(&hash);
+
+  if (budget("hypercore_crypto_randombytes", 0, 0)) {
+    ok("hypercore_crypto_randombytes");
+  }
+
+  if (merkle_run("merkle_next (1 block)", 1, 7, 7)) {
+    ok("merkle_next (1 block)");
+  }
+
+  if (merkle_run("merkle_next (16 blocks)", 16, 157, 157)) {
+    ok("merkle_next (16 blocks)");
+  }
+
+  if (merkle_run("merkle_next (1024 blocks)", 1024, 10296, 10237)) {
+    ok("merkle_next (1024 blocks)");
+  }
+
+  if (hypercore_crypto_allocator_stats().current == start.current) {
+    ok("no leaked bytes");
+  }
+
+  ok_done();
+  return ok_count() == ok_expected() ? 0 : 1;
+}
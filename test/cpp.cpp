@@ -0,0 +1,572 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+
+#include <ok/ok.h>
+
+// the merkle and sha256 development dependencies have no C++ guards
+extern "C" {
+#include <merkle/merkle.h>
+#include <sha256/sha256.h>
+}
+
+#include "hypercore/crypto.hpp"
+#include "hypercore/crypto/crypto.h"
+#include "hypercore/crypto/coroutine.hpp"
+#include "hypercore/crypto/merkle.hpp"
+
+namespace crypto = hypercore::crypto;
+
+using digest = std::array<std::uint8_t, hypercore_crypto_data_BYTES>;
+
+// a fire and forget coroutine that runs until its first suspension
+struct task {
+  struct promise_type {
+    task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+// resumes coroutines on whichever thread calls `run()`
+struct queue {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::coroutine_handle<>> handles;
+
+  void
+  run(std::latch &done) {
+    while (!done.try_wait()) {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [this] { return !handles.empty(); });
+
+      std::coroutine_handle<> handle = handles.front();
+      handles.pop_front();
+      lock.unlock();
+
+      handle.resume();
+    }
+  }
+};
+
+struct queue_executor {
+  queue *target;
+
+  void
+  post(std::coroutine_handle<> handle) const {
+    std::lock_guard<std::mutex> lock(target->mutex);
+    target->handles.push_back(handle);
+    target->cond.notify_one();
+  }
+};
+
+struct result {
+  int rc = -1;
+  std::thread::id thread;
+};
+
+template <crypto::executor Executor>
+static task
+hash_block(
+  crypto::worker_pool &pool,
+  digest &out,
+  std::span<const std::byte> block,
+  Executor executor,
+  result &result,
+  std::latch &done
+) {
+  result.rc = co_await crypto::data(pool, out, block, executor);
+  result.thread = std::this_thread::get_id();
+  done.count_down();
+}
+
+static task
+hash_parent(
+  crypto::worker_pool &pool,
+  digest &out,
+  const hypercore_crypto_node_t &left,
+  const hypercore_crypto_node_t &right,
+  result &result,
+  std::latch &done
+) {
+  result.rc = co_await crypto::parent(pool, out, left, right, crypto::inline_executor {});
+  result.thread = std::this_thread::get_id();
+  done.count_down();
+}
+
+static task
+hash_tree(
+  crypto::worker_pool &pool,
+  digest &out,
+  std::span<const hypercore_crypto_node_t *> roots,
+  result &result,
+  std::latch &done
+) {
+  result.rc = co_await crypto::tree(pool, out, roots, crypto::inline_executor {});
+  result.thread = std::this_thread::get_id();
+  done.count_down();
+}
+
+static task
+verify_message(
+  crypto::worker_pool &pool,
+  std::span<const std::byte> signature,
+  std::span<const std::byte> message,
+  std::span<const std::byte> public_key,
+  result &result,
+  std::latch &done
+) {
+  result.rc = co_await crypto::verify(
+    pool, signature, message, public_key, crypto::inline_executor {});
+  result.thread = std::this_thread::get_id();
+  done.count_down();
+}
+
+static void
+test_awaitables() {
+  // workers may still be leaving `count_down()` when a wait returns, so
+  // every latch outlives the pool, which joins its workers when destroyed
+  std::latch data_done(1);
+  std::latch executor_done(1);
+  std::latch parent_done(1);
+  std::latch tree_done(1);
+  std::latch verify_done(2);
+  crypto::worker_pool pool(2);
+  const std::thread::id self = std::this_thread::get_id();
+  const char message[] = "hello world";
+  std::span<const std::byte> bytes = std::as_bytes(std::span(message));
+
+  if (0 == pool.status()) {
+    ok("worker_pool");
+  }
+
+  // data() matches hypercore_crypto_data() and resumes on a worker
+  {
+    digest out = {};
+    digest expected = {};
+    result result;
+    hypercore_crypto_buffer_t hash = { expected.size(), expected.data() };
+    hypercore_crypto_buffer_t input = { sizeof(message), (unsigned char *) message };
+
+    hypercore_crypto_data(&hash, &input);
+    hash_block(pool, out, bytes, crypto::inline_executor {}, result, data_done);
+    data_done.wait();
+
+    if (0 == result.rc && expected == out && self != result.thread) {
+      ok("data (awaitable)");
+    }
+  }
+
+  // a caller supplied executor resumes on the caller's thread
+  {
+    digest out = {};
+    digest expected = {};
+    result result;
+    queue loop;
+    hypercore_crypto_buffer_t hash = { expected.size(), expected.data() };
+    hypercore_crypto_buffer_t input = { sizeof(message), (unsigned char *) message };
+
+    hypercore_crypto_data(&hash, &input);
+    hash_block(pool, out, bytes, queue_executor { &loop }, result, executor_done);
+    loop.run(executor_done);
+
+    if (0 == result.rc && expected == out && self == result.thread) {
+      ok("data (awaitable, caller executor)");
+    }
+  }
+
+  // parent() and tree() match the synchronous functions
+  {
+    digest left_hash = {};
+    digest right_hash = {};
+    digest out = {};
+    digest expected = {};
+    result result;
+
+    hypercore_crypto_buffer_t hashes[2] = {
+      { left_hash.size(), left_hash.data() },
+      { right_hash.size(), right_hash.data() }
+    };
+
+    hypercore_crypto_buffer_t input = { sizeof(message), (unsigned char *) message };
+    hypercore_crypto_data(&hashes[0], &input);
+    hypercore_crypto_data(&hashes[1], &input);
+
+    hypercore_crypto_node_t left = { 0, sizeof(message), &hashes[0], nullptr };
+    hypercore_crypto_node_t right = { 2, sizeof(message), &hashes[1], nullptr };
+    hypercore_crypto_buffer_t hash = { expected.size(), expected.data() };
+
+    hypercore_crypto_parent(&hash, &left, &right);
+    hash_parent(pool, out, left, right, result, parent_done);
+    parent_done.wait();
+
+    if (0 == result.rc && expected == out && self != result.thread) {
+      ok("parent (awaitable)");
+    }
+
+    const hypercore_crypto_node_t *roots[2] = { &left, &right };
+
+    hypercore_crypto_tree(&hash, roots, 2);
+    hash_tree(pool, out, roots, result, tree_done);
+    tree_done.wait();
+
+    if (0 == result.rc && expected == out) {
+      ok("tree (awaitable)");
+    }
+  }
+
+  // verify() yields 0 for a valid signature and an error otherwise
+  {
+    std::array<std::uint8_t, 32> public_key = {};
+    std::array<std::uint8_t, 64> secret_key = {};
+    std::array<std::uint8_t, 64> signature = {};
+    result valid;
+    result invalid;
+
+    hypercore_crypto_keypair_t keypair = {
+      { public_key.size(), public_key.data() },
+      { secret_key.size(), secret_key.data() }
+    };
+
+    hypercore_crypto_buffer_t sig = { signature.size(), signature.data() };
+    hypercore_crypto_buffer_t input = { sizeof(message), (unsigned char *) message };
+
+    hypercore_crypto_keypair(&keypair, nullptr);
+    hypercore_crypto_sign(&sig, &input, &keypair.secret_key);
+
+    verify_message(
+      pool,
+      std::as_bytes(std::span(signature)),
+      bytes,
+      std::as_bytes(std::span(public_key)),
+      valid,
+      verify_done);
+
+    verify_message(
+      pool,
+      std::as_bytes(std::span(signature)),
+      bytes.first(5),
+      std::as_bytes(std::span(public_key)),
+      invalid,
+      verify_done);
+
+    verify_done.wait();
+
+    if (0 == valid.rc && 0 != invalid.rc) {
+      ok("verify (awaitable)");
+    }
+  }
+}
+
+static void
+test_wrappers() {
+  const char message[] = "hello world";
+  crypto::byte_span bytes = std::as_bytes(std::span(message));
+  hypercore_crypto_buffer_t input = { sizeof(message), (unsigned char *) message };
+  crypto::seed seed = {};
+  crypto::keypair keypair;
+
+  seed.fill(7);
+
+  // generate() matches hypercore_crypto_keypair() for the same seed
+  {
+    std::array<std::uint8_t, 32> public_key = {};
+    std::array<std::uint8_t, 64> secret_key = {};
+    hypercore_crypto_keypair_t expected = {
+      { public_key.size(), public_key.data() },
+      { secret_key.size(), secret_key.data() }
+    };
+
+    hypercore_crypto_keypair(&expected, seed.data());
+
+    if (
+      0 == crypto::generate(keypair, &seed) &&
+      public_key == keypair.public_key &&
+      0 == std::memcmp(secret_key.data(), keypair.secret_key.data(), secret_key.size())
+    ) {
+      ok("generate");
+    }
+  }
+
+  // sign() matches hypercore_crypto_sign() and verify() accepts it
+  {
+    crypto::signature signature = {};
+    crypto::signature expected = {};
+    hypercore_crypto_buffer_t sig = { expected.size(), expected.data() };
+    hypercore_crypto_buffer_t sk = {
+      keypair.secret_key.size(),
+      keypair.secret_key.data()
+    };
+
+    hypercore_crypto_sign(&sig, &input, &sk);
+
+    if (
+      0 == crypto::sign(signature, bytes, keypair.secret_key) &&
+      expected == signature &&
+      crypto::verify(signature, bytes, keypair.public_key) &&
+      !crypto::verify(signature, bytes.first(5), keypair.public_key)
+    ) {
+      ok("sign and verify");
+    }
+  }
+
+  // data(), parent() and tree() match the C functions
+  {
+    crypto::node left;
+    crypto::node right;
+    crypto::hash parent = {};
+    crypto::hash root = {};
+    crypto::hash expected = {};
+    hypercore_crypto_buffer_t hash = { expected.size(), expected.data() };
+
+    hypercore_crypto_data(&hash, &input);
+
+    left = { 0, sizeof(message), {} };
+    right = { 2, sizeof(message), {} };
+
+    if (
+      0 == crypto::data(left.hash, bytes) &&
+      0 == crypto::data(right.hash, bytes) &&
+      expected == left.hash
+    ) {
+      ok("data");
+    }
+
+    hypercore_crypto_buffer_t hashes[2] = {
+      { left.hash.size(), left.hash.data() },
+      { right.hash.size(), right.hash.data() }
+    };
+
+    hypercore_crypto_node_t nodes[2] = {
+      { left.index, left.size, &hashes[0], nullptr },
+      { right.index, right.size, &hashes[1], nullptr }
+    };
+
+    const hypercore_crypto_node_t *roots[2] = { &nodes[0], &nodes[1] };
+
+    hypercore_crypto_parent(&hash, &nodes[0], &nodes[1]);
+
+    if (0 == crypto::parent(parent, left, right) && expected == parent) {
+      ok("parent");
+    }
+
+    crypto::node list[2] = { left, right };
+    crypto::node many[crypto::max_roots + 1];
+
+    hypercore_crypto_tree(&hash, roots, 2);
+
+    if (
+      0 == crypto::tree(root, list) &&
+      expected == root &&
+      -EINVAL == crypto::tree(root, many)
+    ) {
+      ok("tree");
+    }
+  }
+
+  // discovery_key() matches hypercore_crypto_discoverykey()
+  {
+    crypto::hash key = {};
+    crypto::hash expected = {};
+    hypercore_crypto_buffer_t hash = { expected.size(), expected.data() };
+    hypercore_crypto_buffer_t pk = {
+      keypair.public_key.size(),
+      keypair.public_key.data()
+    };
+
+    hypercore_crypto_discoverykey(&hash, &pk);
+
+    if (0 == crypto::discovery_key(key, keypair.public_key) && expected == key) {
+      ok("discovery_key");
+    }
+  }
+
+  // secret keys are zeroed when moved from and when cleared
+  {
+    crypto::secret_key moved(std::move(keypair.secret_key));
+    crypto::secret_key zero;
+    bool zeroed = 0 == std::memcmp(
+      keypair.secret_key.data(),
+      zero.data(),
+      zero.size());
+
+    moved.clear();
+
+    if (zeroed && 0 == std::memcmp(moved.data(), zero.data(), zero.size())) {
+      ok("secret_key");
+    }
+  }
+}
+
+/**
+ * SHA-256 node hashing from `deps/sha256`, the same as the default
+ * codec of `merkle_init()`.
+ */
+struct sha256_policy {
+  static constexpr std::size_t digest_size = SHA256_DIGEST_SIZE;
+  using node = crypto::merkle_node<digest_size>;
+
+  static void
+  leaf(node &out, std::span<const std::byte> data) noexcept {
+    sha256_hash(
+      out.hash.data(),
+      reinterpret_cast<const unsigned char *>(data.data()),
+      data.size());
+  }
+
+  static void
+  parent(node &out, const node &left, const node &right) noexcept {
+    sha256_t state;
+    sha256_init(&state);
+    sha256_update(&state, left.hash.data(), digest_size);
+    sha256_update(&state, right.hash.data(), digest_size);
+    sha256_final(&state, out.hash.data());
+  }
+};
+
+template <typename Node>
+static bool
+same(const Node &node, const merkle_node_t *other) {
+  return
+    node.index == other->index &&
+    node.parent == other->parent &&
+    node.size == other->size &&
+    node.hash.size() == other->hash_size &&
+    0 == std::memcmp(node.hash.data(), other->hash, node.hash.size());
+}
+
+static void
+test_merkle_builder() {
+  crypto::merkle_builder<sha256_policy> builder;
+  crypto::merkle_builder<sha256_policy>::node_list nodes;
+  crypto::merkle_builder<sha256_policy>::node_list lazy_nodes;
+  merkle_t eager = {};
+  merkle_t lazy = {};
+  merkle_node_list_t *list = nullptr;
+  bool eager_equal = true;
+  bool lazy_equal = true;
+
+  merkle_init(&eager, MERKLE_DEFAULT_OPTIONS);
+  merkle_init(&lazy, (merkle_options_t) { .lazy = 1 });
+
+  for (std::uint64_t i = 0; i < 100; ++i) {
+    std::span<const std::byte> block = std::as_bytes(std::span(&i, 1));
+
+    nodes.clear();
+    builder.next(block, nodes);
+
+    // the same nodes, in the same order, as merkle_next()
+    list = merkle_next(&eager, (unsigned char *) &i, sizeof(i), nullptr);
+    eager_equal = eager_equal && nodes.size() == list->length;
+
+    for (std::size_t j = 0; eager_equal && j < nodes.size(); ++j) {
+      eager_equal = same(nodes[j], list->list[j]);
+    }
+
+    merkle_node_list_destroy(list);
+    lazy_nodes.insert(lazy_nodes.end(), nodes.begin(), nodes.end());
+
+    // a lazy tree flushed every 7 blocks hashes the same nodes
+    list = merkle_next(&lazy, (unsigned char *) &i, sizeof(i), nullptr);
+
+    if (6 == i % 7 || 99 == i) {
+      list = merkle_flush(&lazy, list);
+    }
+
+    for (unsigned long int j = 0; lazy_equal && j < list->length; ++j) {
+      auto node = std::find_if(
+        lazy_nodes.begin(),
+        lazy_nodes.end(),
+        [&](const auto &node) { return node.index == list->list[j]->index; });
+
+      lazy_equal = lazy_nodes.end() != node && same(*node, list->list[j]);
+    }
+
+    merkle_node_list_destroy(list);
+  }
+
+  if (eager_equal) {
+    ok("merkle_builder (merkle_next)");
+  }
+
+  bool roots_equal = lazy_equal && builder.roots().size() == lazy.roots.length;
+
+  for (std::size_t i = 0; roots_equal && i < builder.roots().size(); ++i) {
+    roots_equal = same(builder.roots()[i], lazy.roots.list[i]);
+  }
+
+  if (roots_equal && 100 == builder.blocks()) {
+    ok("merkle_builder (merkle_flush)");
+  }
+
+  merkle_destroy(&eager);
+  merkle_destroy(&lazy);
+
+  // blake2b_policy hashes like hypercore_crypto_data() and _parent()
+  crypto::merkle_builder<crypto::blake2b_policy> blake2b;
+  crypto::merkle_builder<crypto::blake2b_policy>::node_list blake2b_nodes;
+  std::array<std::uint8_t, hypercore_crypto_data_BYTES> leaves[2] = {};
+  std::array<std::uint8_t, hypercore_crypto_data_BYTES> expected = {};
+  unsigned char block[] = "block";
+
+  for (auto &leaf : leaves) {
+    hypercore_crypto_buffer_t hash = { leaf.size(), leaf.data() };
+    hypercore_crypto_buffer_t input = { sizeof(block), block };
+    hypercore_crypto_data(&hash, &input);
+  }
+
+  hypercore_crypto_buffer_t hashes[2] = {
+    { leaves[0].size(), leaves[0].data() },
+    { leaves[1].size(), leaves[1].data() }
+  };
+
+  hypercore_crypto_node_t children[2] = {
+    { 0, sizeof(block), &hashes[0], nullptr },
+    { 2, sizeof(block), &hashes[1], nullptr }
+  };
+
+  hypercore_crypto_buffer_t parent = { expected.size(), expected.data() };
+  hypercore_crypto_parent(&parent, &children[0], &children[1]);
+
+  blake2b.next(std::as_bytes(std::span(block)), blake2b_nodes);
+  blake2b.next(std::as_bytes(std::span(block)), blake2b_nodes);
+
+  if (
+    3 == blake2b_nodes.size() &&
+    leaves[0] == blake2b_nodes[0].hash &&
+    leaves[1] == blake2b_nodes[1].hash &&
+    1 == blake2b_nodes[2].index &&
+    expected == blake2b_nodes[2].hash
+  ) {
+    ok("merkle_builder (blake2b_policy)");
+  }
+}
+
+int
+main(void) {
+#ifdef OK_EXPECTED
+  ok_expect(OK_EXPECTED);
+#else
+  ok_expect(0);
+#endif
+
+  test_awaitables();
+  test_wrappers();
+  test_merkle_builder();
+
+  ok_done();
+  return ok_count() == ok_expected() ? 0 : 1;
+}
@@ -1,8 +1,11 @@
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #include <sodium.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <merkle/allocator.h>
 #include <merkle/merkle.h>
 #include <ok/ok.h>
 
@@ -10,6 +13,74 @@
 
 #define bytes(b) (unsigned char *) (b)
 
+static int scoped_allocs = 0;
+
+static void *
+scoped_alloc(void *ctx, unsigned long int size) {
+  (void) scoped_allocs++;
+  return malloc(size);
+}
+
+static void
+scoped_free(void *ctx, void *ptr) {
+  (void) scoped_allocs--;
+  free(ptr);
+}
+
+// merkle allocations are filled with garbage and followed by a canary,
+// so a node list written past its end is caught without a sanitizer
+static int guard_errors = 0;
+
+static void *
+guarded_alloc(unsigned long int size) {
+  unsigned char *bytes = malloc(sizeof(size) + size + 16);
+
+  if (0 == bytes) {
+    return 0;
+  }
+
+  memcpy(bytes, &size, sizeof(size));
+  memset(bytes + sizeof(size), 0xff, size);
+  memset(bytes + sizeof(size) + size, 0x5a, 16);
+
+  return bytes + sizeof(size);
+}
+
+static void
+guarded_free(void *ptr) {
+  unsigned char *bytes = (unsigned char *) ptr - sizeof(unsigned long int);
+  unsigned long int size = 0;
+
+  if (0 == ptr) {
+    return;
+  }
+
+  memcpy(&size, bytes, sizeof(size));
+
+  for (int i = 0; i < 16; ++i) {
+    if (0x5a != bytes[sizeof(size) + size + i]) {
+      (void) guard_errors++;
+      break;
+    }
+  }
+
+  free(bytes);
+}
+
+static void *
+guarded_realloc(void *ptr, unsigned long int size) {
+  unsigned char *bytes = guarded_alloc(size);
+  unsigned long int previous = 0;
+
+  if (0 != ptr && 0 != bytes) {
+    memcpy(&previous, (unsigned char *) ptr - sizeof(previous), sizeof(previous));
+    memcpy(bytes, ptr, previous < size ? previous : size);
+    guarded_free(ptr);
+  }
+
+  return bytes;
+}
+
 void
 printb(unsigned char *bytes, unsigned long int size) {
   for (int i = 0; i < size; ++i) {
@@ -188,6 +259,427 @@ main(void) {
 
   merkle_destroy(&merkle);
 
+  // node lists grow before they are full, whatever is past their end
+  merkle_allocator_set(guarded_alloc);
+  merkle_reallocator_set(guarded_realloc);
+  merkle_deallocator_set(guarded_free);
+  merkle_node_list_t *grown = 0;
+  merkle_init(&merkle, MERKLE_DEFAULT_OPTIONS);
+
+  for (unsigned long int i = 0; i < 100; ++i) {
+    grown = merkle_next(&merkle, bytes(&i), sizeof(i), grown);
+  }
+
+  if (197 != grown->length) {
+    (void) guard_errors++;
+  }
+
+  merkle_node_list_destroy(grown);
+  merkle_destroy(&merkle);
+  merkle_allocator_set(malloc);
+  merkle_reallocator_set(realloc);
+  merkle_deallocator_set(free);
+
+  if (0 == guard_errors) {
+    ok("merkle_next (node list bounds)");
+  }
+
+  // a lazy tree flushed part way and at the end matches an eager one
+  merkle_t eager = { 0 };
+  merkle_t lazy = { 0 };
+  unsigned char (*eager_hashes)[32] = calloc(2048, 32);
+  unsigned char (*lazy_hashes)[32] = calloc(2048, 32);
+  unsigned long int eager_count = 0;
+  unsigned long int lazy_count = 0;
+  merkle_node_list_t *nodes = 0;
+  int lazy_equal = 1;
+
+  merkle_init(&eager, MERKLE_DEFAULT_OPTIONS);
+  merkle_init(&lazy, (merkle_options_t) { .lazy = 1 });
+
+  for (unsigned long int i = 0; i < 1000; ++i) {
+    nodes = merkle_next(&eager, bytes(&i), sizeof(i), 0);
+    for (unsigned long int j = 0; j < nodes->length; ++j, ++eager_count) {
+      memcpy(eager_hashes[nodes->list[j]->index], nodes->list[j]->hash, 32);
+    }
+    merkle_node_list_destroy(nodes);
+
+    nodes = merkle_next(&lazy, bytes(&i), sizeof(i), 0);
+
+    if (333 == i || 999 == i) {
+      nodes = merkle_flush(&lazy, nodes);
+    }
+
+    for (unsigned long int j = 0; j < nodes->length; ++j, ++lazy_count) {
+      memcpy(lazy_hashes[nodes->list[j]->index], nodes->list[j]->hash, 32);
+    }
+    merkle_node_list_destroy(nodes);
+  }
+
+  lazy_equal = lazy_equal && eager_count == lazy_count;
+  lazy_equal = lazy_equal && 0 == memcmp(eager_hashes, lazy_hashes, 2048 * 32);
+  lazy_equal = lazy_equal && eager.roots.length == lazy.roots.length;
+
+  for (unsigned long int i = 0; lazy_equal && i < lazy.roots.length; ++i) {
+    lazy_equal =
+      eager.roots.list[i]->index == lazy.roots.list[i]->index &&
+      eager.roots.list[i]->size == lazy.roots.list[i]->size &&
+      0 == memcmp(eager.roots.list[i]->hash, lazy.roots.list[i]->hash, 32);
+  }
+
+  if (lazy_equal) {
+    ok("merkle_flush");
+  }
+
+  merkle_destroy(&eager);
+  merkle_destroy(&lazy);
+  free(eager_hashes);
+  free(lazy_hashes);
+
+  // appended and updated tree hashes match `hypercore_crypto_tree()`
+  hypercore_crypto_tree_hash_t appended;
+  hypercore_crypto_tree_hash_t updated;
+  hypercore_crypto_buffer_t tree_hashes[64];
+  hypercore_crypto_node_t tree_roots[64];
+  const hypercore_crypto_node_t *tree_pointers[64];
+  unsigned char tree_expected[32];
+  unsigned char tree_appended[32];
+  unsigned char tree_updated[32];
+  int tree_equal = 1;
+
+  hypercore_crypto_tree_hash_init(&appended);
+  hypercore_crypto_tree_hash_init(&updated);
+  merkle_init(&merkle, MERKLE_DEFAULT_OPTIONS);
+
+  for (unsigned long int i = 0; tree_equal && i < 300; ++i) {
+    hypercore_crypto_buffer_t expected = { 32, tree_expected };
+    hypercore_crypto_buffer_t actual = { 32, tree_appended };
+    hypercore_crypto_buffer_t actual_updated = { 32, tree_updated };
+
+    nodes = merkle_next(&merkle, bytes(&i), sizeof(i), 0);
+
+    for (unsigned long int j = 0; j < nodes->length; ++j) {
+      hypercore_crypto_buffer_t hash = { 32, nodes->list[j]->hash };
+      hypercore_crypto_node_t node = {
+        .index = nodes->list[j]->index,
+        .size = nodes->list[j]->size,
+        .hash = &hash
+      };
+
+      hypercore_crypto_tree_hash_append(&appended, &node);
+    }
+
+    merkle_node_list_destroy(nodes);
+
+    for (unsigned long int j = 0; j < merkle.roots.length; ++j) {
+      tree_hashes[j] = (hypercore_crypto_buffer_t) { 32, merkle.roots.list[j]->hash };
+      tree_roots[j] = (hypercore_crypto_node_t) {
+        .index = merkle.roots.list[j]->index,
+        .size = merkle.roots.list[j]->size,
+        .hash = &tree_hashes[j]
+      };
+      tree_pointers[j] = &tree_roots[j];
+    }
+
+    hypercore_crypto_tree(&expected, tree_pointers, merkle.roots.length);
+    hypercore_crypto_tree_hash_update(&updated, tree_pointers, merkle.roots.length);
+    hypercore_crypto_tree_hash_final(&appended, &actual);
+    hypercore_crypto_tree_hash_final(&updated, &actual_updated);
+
+    tree_equal =
+      0 == memcmp(tree_expected, tree_appended, 32) &&
+      0 == memcmp(tree_expected, tree_updated, 32);
+  }
+
+  if (tree_equal) {
+    ok("hypercore_crypto_tree_hash");
+  }
+
+  // a root with the same index and length but another hash is encoded
+  unsigned char rewritten_hash[32];
+  unsigned char rewritten_expected[32];
+  hypercore_crypto_buffer_t rewritten_buffer = { 32, rewritten_hash };
+  hypercore_crypto_node_t rewritten = tree_roots[0];
+  const hypercore_crypto_node_t *rewritten_pointers[64];
+
+  memcpy(rewritten_hash, tree_roots[0].hash->bytes, 32);
+  rewritten_hash[0] ^= 0xff;
+  rewritten.hash = &rewritten_buffer;
+  memcpy(rewritten_pointers, tree_pointers, sizeof(tree_pointers));
+  rewritten_pointers[0] = &rewritten;
+
+  hypercore_crypto_tree(
+    &(hypercore_crypto_buffer_t) { 32, rewritten_expected },
+    rewritten_pointers,
+    merkle.roots.length);
+
+  hypercore_crypto_tree_hash_update(&updated, rewritten_pointers, merkle.roots.length);
+  hypercore_crypto_tree_hash_final(&updated, &(hypercore_crypto_buffer_t) { 32, tree_updated });
+
+  if (0 == memcmp(rewritten_expected, tree_updated, 32)) {
+    ok("hypercore_crypto_tree_hash_update (same index and length)");
+  }
+
+  // signing the roots is signing their tree hash
+  unsigned char roots_signature[64];
+  unsigned char tree_signature[64];
+  unsigned char expected_signature[64];
+  hypercore_crypto_buffer_t roots_signed = { 64, roots_signature };
+  hypercore_crypto_buffer_t tree_signed = { 64, tree_signature };
+  hypercore_crypto_buffer_t expected_signed = { 64, expected_signature };
+
+  hypercore_crypto_sign(
+    &expected_signed,
+    &(hypercore_crypto_buffer_t) { 32, tree_expected },
+    &keypair.secret_key);
+
+  if (
+    0 == hypercore_crypto_sign_roots(
+      &roots_signed,
+      tree_pointers,
+      merkle.roots.length,
+      &keypair.secret_key) &&
+    0 == hypercore_crypto_tree_hash_sign(
+      &appended,
+      &tree_signed,
+      &keypair.secret_key) &&
+    0 == memcmp(expected_signature, roots_signature, 64) &&
+    0 == memcmp(expected_signature, tree_signature, 64)
+  ) {
+    ok("hypercore_crypto_sign_roots");
+  }
+
+  merkle_destroy(&merkle);
+
+  // signs every 8 blocks and the rest on flush
+  hypercore_crypto_commit_t commit;
+  hypercore_crypto_commit_options_t commit_options = { .blocks = 8 };
+  hypercore_crypto_buffer_t commit_signed = { 64, roots_signature };
+  unsigned long long commit_lengths[4] = { 0 };
+  unsigned long long commit_length = 0;
+  unsigned long int commits = 0;
+
+  hypercore_crypto_commit_init(&commit, &keypair.secret_key, commit_options);
+  merkle_init(&merkle, MERKLE_DEFAULT_OPTIONS);
+
+  for (unsigned long int i = 0; i < 20; ++i) {
+    hypercore_crypto_buffer_t hashes[64];
+    hypercore_crypto_node_t appended_nodes[64];
+    const hypercore_crypto_node_t *pointers[64];
+
+    nodes = merkle_next(&merkle, bytes(&i), sizeof(i), 0);
+
+    for (unsigned long int j = 0; j < nodes->length; ++j) {
+      hashes[j] = (hypercore_crypto_buffer_t) { 32, nodes->list[j]->hash };
+      appended_nodes[j] = (hypercore_crypto_node_t) {
+        .index = nodes->list[j]->index,
+        .size = nodes->list[j]->size,
+        .hash = &hashes[j]
+      };
+      pointers[j] = &appended_nodes[j];
+    }
+
+    rc = hypercore_crypto_commit_append(
+      &commit,
+      pointers,
+      nodes->length,
+      &commit_signed,
+      &commit_length);
+
+    if (1 == rc && commits < 4) {
+      commit_lengths[commits++] = commit_length;
+    }
+
+    merkle_node_list_destroy(nodes);
+  }
+
+  if (1 == hypercore_crypto_commit_flush(&commit, &commit_signed, &commit_length)) {
+    commit_lengths[commits++] = commit_length;
+  }
+
+  hypercore_crypto_tree_hash_sign(&commit.tree, &tree_signed, &keypair.secret_key);
+
+  if (
+    3 == commits &&
+    8 == commit_lengths[0] &&
+    16 == commit_lengths[1] &&
+    20 == commit_lengths[2] &&
+    0 == hypercore_crypto_commit_flush(&commit, &commit_signed, &commit_length) &&
+    0 == memcmp(roots_signature, tree_signature, 64)
+  ) {
+    ok("hypercore_crypto_commit_append");
+  }
+
+  merkle_destroy(&merkle);
+
+  // an idle writer is signed once the oldest append is old enough
+  hypercore_crypto_node_t commit_leaf = {
+    .index = 0,
+    .size = 32,
+    .hash = &(hypercore_crypto_buffer_t) { 32, tree_expected }
+  };
+
+  const hypercore_crypto_node_t *commit_leaves[] = { &commit_leaf };
+
+  commit_options = (hypercore_crypto_commit_options_t) {
+    .blocks = 1000,
+    .microseconds = 1000
+  };
+
+  hypercore_crypto_commit_init(&commit, &keypair.secret_key, commit_options);
+  hypercore_crypto_commit_append(&commit, commit_leaves, 1, &commit_signed, 0);
+  poll(0, 0, 2);
+
+  if (
+    1 == hypercore_crypto_commit_poll(&commit, &commit_signed, &commit_length) &&
+    1 == commit_length
+  ) {
+    ok("hypercore_crypto_commit_poll");
+  }
+
+  // five blocks, the roots are 3 (blocks 0 to 3) and 8 (block 4)
+  unsigned char block_hashes[9][32];
+  hypercore_crypto_buffer_t block_buffers[9];
+  hypercore_crypto_node_t block_nodes[9];
+  hypercore_crypto_buffer_t blocks[5] = {
+    { 1, bytes("a") }, { 1, bytes("b") }, { 1, bytes("c") },
+    { 1, bytes("d") }, { 1, bytes("e") }
+  };
+
+  for (unsigned long int i = 0; i < 9; ++i) {
+    block_buffers[i] = (hypercore_crypto_buffer_t) { 32, block_hashes[i] };
+    block_nodes[i] = (hypercore_crypto_node_t) {
+      .index = i,
+      .size = 1,
+      .hash = &block_buffers[i]
+    };
+
+    if (0 == i % 2) {
+      hypercore_crypto_data(&block_buffers[i], &blocks[i / 2]);
+    }
+  }
+
+  block_nodes[1].size = block_nodes[5].size = 2;
+  block_nodes[3].size = 4;
+  hypercore_crypto_parent(&block_buffers[1], &block_nodes[0], &block_nodes[2]);
+  hypercore_crypto_parent(&block_buffers[5], &block_nodes[4], &block_nodes[6]);
+  hypercore_crypto_parent(&block_buffers[3], &block_nodes[1], &block_nodes[5]);
+
+  const hypercore_crypto_node_t *block_roots[] = { &block_nodes[3], &block_nodes[8] };
+  const hypercore_crypto_node_t *block_siblings[] = { &block_nodes[6], &block_nodes[1] };
+  hypercore_crypto_buffer_t block_signature = { 64, roots_signature };
+
+  hypercore_crypto_sign_roots(&block_signature, block_roots, 2, &keypair.secret_key);
+
+  if (
+    0 == hypercore_crypto_verify_block(
+      &blocks[2], 2, block_siblings, 2, block_roots, 2,
+      &block_signature, &keypair.public_key) &&
+    0 == hypercore_crypto_verify_block(
+      &blocks[4], 4, 0, 0, block_roots, 2,
+      &block_signature, &keypair.public_key) &&
+    0 != hypercore_crypto_verify_block(
+      &blocks[3], 2, block_siblings, 2, block_roots, 2,
+      &block_signature, &keypair.public_key) &&
+    0 != hypercore_crypto_verify_block(
+      &blocks[2], 2, block_siblings, 1, block_roots, 2,
+      &block_signature, &keypair.public_key)
+  ) {
+    ok("hypercore_crypto_verify_block");
+  }
+
+  // eleven blocks, the roots are 7 (blocks 0 to 7), 17 (8 and 9) and 20 (10)
+  unsigned long int range_values[11];
+  unsigned char range_hashes[21][32];
+  hypercore_crypto_buffer_t range_blocks[11];
+  hypercore_crypto_buffer_t range_buffers[21];
+  hypercore_crypto_node_t range_nodes[21];
+
+  for (unsigned long int i = 0; i < 21; ++i) {
+    range_buffers[i] = (hypercore_crypto_buffer_t) { 32, range_hashes[i] };
+    range_nodes[i] = (hypercore_crypto_node_t) {
+      .index = i,
+      .hash = &range_buffers[i]
+    };
+
+    if (0 == i % 2) {
+      range_values[i / 2] = i / 2;
+      range_blocks[i / 2] = (hypercore_crypto_buffer_t) {
+        sizeof(range_values[i / 2]),
+        bytes(&range_values[i / 2])
+      };
+
+      range_nodes[i].size = range_blocks[i / 2].size;
+      hypercore_crypto_data(&range_buffers[i], &range_blocks[i / 2]);
+    }
+  }
+
+  for (unsigned long int depth = 1; depth < 4; ++depth) {
+    unsigned long int half = 1UL << (depth - 1);
+
+    for (unsigned long int i = (1UL << depth) - 1; i + half < 21; i += 1UL << (depth + 1)) {
+      range_nodes[i].size = range_nodes[i - half].size + range_nodes[i + half].size;
+      hypercore_crypto_parent(
+        &range_buffers[i],
+        &range_nodes[i - half],
+        &range_nodes[i + half]);
+    }
+  }
+
+  // blocks 1, 2, 4 and 10 share their siblings and need 4 nodes, not 9
+  unsigned long long ranges[] = { 1, 3, 4, 5, 10, 11 };
+  unsigned long long range_indices[8] = { 0 };
+  unsigned long long range_count = 8;
+  unsigned long long short_count = 2;
+
+  if (
+    0 == hypercore_crypto_proof_nodes(11, ranges, 3, range_indices, &range_count) &&
+    4 == range_count &&
+    0 == range_indices[0] &&
+    6 == range_indices[1] &&
+    10 == range_indices[2] &&
+    13 == range_indices[3] &&
+    -ERANGE == hypercore_crypto_proof_nodes(11, ranges, 3, range_indices, &short_count) &&
+    4 == short_count
+  ) {
+    ok("hypercore_crypto_proof_nodes");
+  }
+
+  const hypercore_crypto_node_t *range_roots[] = {
+    &range_nodes[7],
+    &range_nodes[17],
+    &range_nodes[20]
+  };
+
+  const hypercore_crypto_node_t *range_proof[4];
+  hypercore_crypto_buffer_t requested[] = {
+    range_blocks[1], range_blocks[2], range_blocks[4], range_blocks[10]
+  };
+
+  for (unsigned long int i = 0; i < 4; ++i) {
+    range_proof[i] = &range_nodes[range_indices[i]];
+  }
+
+  hypercore_crypto_sign_roots(&block_signature, range_roots, 3, &keypair.secret_key);
+
+  int range_verified = 0 == hypercore_crypto_proof_verify(
+    ranges, 3, requested, range_proof, 4, range_roots, 3,
+    &block_signature, &keypair.public_key);
+
+  int range_missing = 0 != hypercore_crypto_proof_verify(
+    ranges, 3, requested, range_proof, 3, range_roots, 3,
+    &block_signature, &keypair.public_key);
+
+  requested[2] = range_blocks[5];
+
+  int range_tampered = 0 != hypercore_crypto_proof_verify(
+    ranges, 3, requested, range_proof, 4, range_roots, 3,
+    &block_signature, &keypair.public_key);
+
+  if (range_verified && range_missing && range_tampered) {
+    ok("hypercore_crypto_proof_verify");
+  }
+
   hypercore_crypto_buffer_t randombytes = {
     .size = 32,
     .bytes = (unsigned char [32]) { 0 }
@@ -196,6 +688,19 @@ main(void) {
   if (32 == hypercore_crypto_randombytes(&randombytes)) {
     ok("hypercore_crypto_randombytes");
   }
+
+  unsigned char pooled[2][24] = { { 0 } };
+  hypercore_crypto_randombytes_pool_set(1);
+  hypercore_crypto_randombytes(&(hypercore_crypto_buffer_t) { 24, pooled[0] });
+  hypercore_crypto_randombytes(&(hypercore_crypto_buffer_t) { 24, pooled[1] });
+  hypercore_crypto_randombytes_pool_set(0);
+
+  if (
+    0 != memcmp(pooled[0], pooled[1], 24) &&
+    0 != memcmp(pooled[0], (unsigned char [24]) { 0 }, 24)
+  ) {
+    ok("hypercore_crypto_randombytes_pool_set");
+  }
   //printb(randombytes.bytes, randombytes.size);
 
   unsigned char key[] = {
@@ -221,6 +726,410 @@ main(void) {
     ok(" hypercore_crypto_discoverykey");
   }
 
+  hypercore_crypto_buffer_t discoverykeys = { 0 };
+  hypercore_crypto_buffer_t keys[] = {
+    { 32, key },
+    { 32, key }
+  };
+
+  hypercore_crypto_buffer_t no_discoverykeys = { 0 };
+  int empty_rc = hypercore_crypto_discoverykey_many(&no_discoverykeys, keys, 0);
+
+  rc = hypercore_crypto_discoverykey_many(&discoverykeys, keys, 2);
+
+  if (
+    0 == rc &&
+    64 == discoverykeys.size &&
+    0 == empty_rc &&
+    0 == no_discoverykeys.bytes &&
+    0 == memcmp(expected, discoverykeys.bytes, 32) &&
+    0 == memcmp(expected, discoverykeys.bytes + 32, 32)
+  ) {
+    ok("hypercore_crypto_discoverykey_many");
+  }
+
+  hypercore_crypto_free(discoverykeys.bytes);
+
+  unsigned char master[32] = { 0 };
+  unsigned char seed[32] = { 0 };
+  hypercore_crypto_keypair_t derived[3] = { 0 };
+  hypercore_crypto_keypair_t expected_keypair = { 0 };
+  hypercore_crypto_buffer_t names[] = {
+    { 1, bytes("a") },
+    { 1, bytes("b") },
+    { 1, bytes("a") }
+  };
+
+  crypto_generichash(seed, 32, bytes("hypercorea"), 10, master, 32);
+  hypercore_crypto_keypair(&expected_keypair, seed);
+  hypercore_crypto_keypair_t no_derived[1] = { 0 };
+  int empty_derive_rc = hypercore_crypto_keypair_derive_many(master, names, 0, no_derived);
+  int range_derive_rc = hypercore_crypto_keypair_derive_many(master, names, (unsigned long long) -1, no_derived);
+
+  rc = hypercore_crypto_keypair_derive_many(master, names, 3, derived);
+
+  if (
+    0 == rc &&
+    0 == empty_derive_rc &&
+    -ERANGE == range_derive_rc &&
+    0 == no_derived[0].secret_key.bytes &&
+    0 == memcmp(derived[0].secret_key.bytes, expected_keypair.secret_key.bytes, 64) &&
+    0 == memcmp(derived[2].public_key.bytes, expected_keypair.public_key.bytes, 32) &&
+    0 != memcmp(derived[1].public_key.bytes, expected_keypair.public_key.bytes, 32) &&
+    derived[0].secret_key.bytes + 64 == derived[1].secret_key.bytes
+  ) {
+    ok("hypercore_crypto_keypair_derive_many");
+  }
+
+  hypercore_crypto_keypair_destroy_many(derived, 3);
+  hypercore_crypto_keypair_destroy(&expected_keypair);
+
+  hypercore_crypto_keyring_t keyring = { 0 };
+  hypercore_crypto_keypair_t keyring_keypairs[3] = { 0 };
+  long int slots[3] = { 0 };
+
+  hypercore_crypto_keyring_init(&keyring, (hypercore_crypto_keyring_options_t) {
+    .region_slots = 2
+  });
+
+  for (int i = 0; i < 3; ++i) {
+    slots[i] = hypercore_crypto_keyring_keypair(&keyring, &keyring_keypairs[i], 0);
+  }
+
+  if (0 == slots[0] && 1 == slots[1] && 2 == slots[2] && 2 == keyring.length) {
+    ok("hypercore_crypto_keyring_keypair");
+  }
+
+  hypercore_crypto_buffer_t keyring_signature = { 0 };
+  hypercore_crypto_keyring_protect(&keyring, -1, HYPERCORE_CRYPTO_KEYRING_READONLY);
+  hypercore_crypto_sign(
+    &keyring_signature,
+    &(hypercore_crypto_buffer_t) { 5, bytes("hello") },
+    &keyring_keypairs[2].secret_key);
+  hypercore_crypto_keyring_protect(&keyring, -1, HYPERCORE_CRYPTO_KEYRING_READWRITE);
+
+  rc = hypercore_crypto_verify(
+    &keyring_signature,
+    &(hypercore_crypto_buffer_t) { 5, bytes("hello") },
+    &keyring_keypairs[2].public_key);
+
+  if (0 == rc) {
+    ok("hypercore_crypto_keyring_protect");
+  }
+
+  hypercore_crypto_free(keyring_signature.bytes);
+  hypercore_crypto_keyring_free(&keyring, slots[1]);
+
+  if (
+    1 == hypercore_crypto_keyring_alloc(&keyring, &keyring_keypairs[1].secret_key) &&
+    0 == keyring_keypairs[1].secret_key.bytes[0]
+  ) {
+    ok("hypercore_crypto_keyring_free");
+  }
+
+  // slot 3 exists in the second region but was never handed out
+  if (
+    -EINVAL == hypercore_crypto_keyring_free(&keyring, 3) &&
+    0 == hypercore_crypto_keyring_free(&keyring, slots[1]) &&
+    -EINVAL == hypercore_crypto_keyring_free(&keyring, slots[1]) &&
+    2 == keyring.free_length
+  ) {
+    ok("hypercore_crypto_keyring_free (double free)");
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    hypercore_crypto_free(keyring_keypairs[i].public_key.bytes);
+  }
+
+  hypercore_crypto_keyring_destroy(&keyring);
+
+  hypercore_crypto_keypair_pool_t keypair_pool = { 0 };
+  hypercore_crypto_keypair_t pooled_keypairs[6] = { 0 };
+  int popped = 0;
+
+  hypercore_crypto_keypair_pool_init(&keypair_pool,
+    (hypercore_crypto_keypair_pool_options_t) {
+      .capacity = 4,
+      .watermark = 2
+    });
+
+  for (int i = 0; i < 6; ++i) {
+    if (0 == hypercore_crypto_keypair_pool_pop(&keypair_pool, &pooled_keypairs[i])) {
+      (void) popped++;
+    }
+  }
+
+  hypercore_crypto_buffer_t pooled_signature = { 0 };
+  hypercore_crypto_sign(
+    &pooled_signature,
+    &(hypercore_crypto_buffer_t) { 5, bytes("hello") },
+    &pooled_keypairs[5].secret_key);
+
+  rc = hypercore_crypto_verify(
+    &pooled_signature,
+    &(hypercore_crypto_buffer_t) { 5, bytes("hello") },
+    &pooled_keypairs[5].public_key);
+
+  if (
+    6 == popped &&
+    0 == rc &&
+    0 != memcmp(pooled_keypairs[0].public_key.bytes, pooled_keypairs[1].public_key.bytes, 32)
+  ) {
+    ok("hypercore_crypto_keypair_pool_pop");
+  }
+
+  hypercore_crypto_free(pooled_signature.bytes);
+  hypercore_crypto_keypair_pool_destroy(&keypair_pool);
+
+  hypercore_crypto_jobs_t jobs = { 0 };
+  hypercore_crypto_job_t job_list[32] = { 0 };
+  hypercore_crypto_job_t *submitted[32] = { 0 };
+  hypercore_crypto_job_t *completed[32] = { 0 };
+  hypercore_crypto_buffer_t job_hashes[32] = { 0 };
+  hypercore_crypto_buffer_t job_expected = { 0 };
+  unsigned long int completed_count = 0;
+  int job_errors = 0;
+
+  hypercore_crypto_data(&job_expected, &message);
+
+  hypercore_crypto_jobs_init(&jobs, (hypercore_crypto_jobs_options_t) {
+    .threads = 2
+  });
+
+  for (int i = 0; i < 32; ++i) {
+    job_list[i].type = HYPERCORE_CRYPTO_JOB_DATA;
+    job_list[i].out = &job_hashes[i];
+    job_list[i].message = &message;
+    submitted[i] = &job_list[i];
+  }
+
+  hypercore_crypto_jobs_submit(&jobs, submitted, 32);
+
+  while (completed_count < 32) {
+    struct pollfd pfd = { hypercore_crypto_jobs_fd(&jobs), POLLIN, 0 };
+    poll(&pfd, 1, 1000);
+    completed_count += hypercore_crypto_jobs_poll(
+      &jobs,
+      completed + completed_count,
+      32 - completed_count);
+  }
+
+  hypercore_crypto_jobs_destroy(&jobs);
+
+  for (int i = 0; i < 32; ++i) {
+    if (
+      0 != completed[i]->rc ||
+      0 != memcmp(completed[i]->out->bytes, job_expected.bytes, 32)
+    ) {
+      (void) job_errors++;
+    }
+  }
+
+  // jobs complete out of order, so no hash is freed before every check
+  for (int i = 0; i < 32; ++i) {
+    hypercore_crypto_free(job_hashes[i].bytes);
+  }
+
+  if (0 == job_errors) {
+    ok("hypercore_crypto_jobs_submit");
+  }
+
+  hypercore_crypto_free(job_expected.bytes);
+
+  hypercore_crypto_allocator_t scoped = { 0, scoped_alloc, scoped_free };
+  hypercore_crypto_buffer_t scoped_hash = { 0 };
+  int scoped_count = 0;
+
+  hypercore_crypto_allocator_push(&scoped);
+  hypercore_crypto_data(&scoped_hash, &message);
+  scoped_count = scoped_allocs;
+  hypercore_crypto_free(scoped_hash.bytes);
+  hypercore_crypto_allocator_pop();
+
+  if (1 == scoped_count && 0 == scoped_allocs) {
+    ok("hypercore_crypto_allocator_push");
+  }
+
+  // scopes never carry key material
+  hypercore_crypto_keypair_t scoped_keypair = { 0 };
+  hypercore_crypto_keypair_t scoped_derived[2] = { 0 };
+  hypercore_crypto_keypair_t scoped_popped = { 0 };
+  hypercore_crypto_keypair_pool_t scoped_pool = { 0 };
+
+  hypercore_crypto_keypair_pool_init(&scoped_pool, HYPERCORE_CRYPTO_KEYPAIR_POOL_DEFAULT_OPTIONS);
+  hypercore_crypto_allocator_push(&scoped);
+  rc = hypercore_crypto_keypair(&scoped_keypair, 0);
+  rc |= hypercore_crypto_keypair_derive_many(master, names, 2, scoped_derived);
+  rc |= hypercore_crypto_keypair_pool_pop(&scoped_pool, &scoped_popped);
+  hypercore_crypto_allocator_pop();
+  scoped_count = scoped_allocs;
+  hypercore_crypto_keypair_destroy(&scoped_keypair);
+  hypercore_crypto_keypair_destroy_many(scoped_derived, 2);
+  hypercore_crypto_keypair_destroy(&scoped_popped);
+  hypercore_crypto_keypair_pool_destroy(&scoped_pool);
+
+  // only the three public key regions
+  if (0 == rc && 3 == scoped_count && 0 == scoped_allocs) {
+    ok("hypercore_crypto_allocator_push (secret keys)");
+  }
+
+  // blocks go back to the allocator that served them from any scope
+  hypercore_crypto_buffer_t unscoped_hash = { 0 };
+  hypercore_crypto_buffer_t other_hash = { 0 };
+
+  hypercore_crypto_data(&unscoped_hash, &message);
+  hypercore_crypto_allocator_push(&scoped);
+  hypercore_crypto_data(&other_hash, &message);
+  hypercore_crypto_free(unscoped_hash.bytes);
+  hypercore_crypto_allocator_pop();
+  scoped_count = scoped_allocs;
+  hypercore_crypto_free(other_hash.bytes);
+
+  if (1 == scoped_count && 0 == scoped_allocs) {
+    ok("hypercore_crypto_free (other scope)");
+  }
+
+  // merkle trees allocate through the same scopes as the library
+  merkle_t scoped_merkle = { 0 };
+
+  merkle_allocator_set(hypercore_crypto_alloc);
+  merkle_reallocator_set(hypercore_crypto_realloc);
+  merkle_deallocator_set(hypercore_crypto_free);
+  hypercore_crypto_allocator_push(&scoped);
+  merkle_init(&scoped_merkle, MERKLE_DEFAULT_OPTIONS);
+
+  for (unsigned long int i = 0; i < 16; ++i) {
+    merkle_node_list_destroy(merkle_next(&scoped_merkle, bytes(&i), sizeof(i), 0));
+  }
+
+  scoped_count = scoped_allocs;
+  merkle_destroy(&scoped_merkle);
+  hypercore_crypto_allocator_pop();
+  merkle_allocator_set(malloc);
+  merkle_reallocator_set(realloc);
+  merkle_deallocator_set(free);
+
+  if (scoped_count > 0 && 0 == scoped_allocs) {
+    ok("merkle_allocator_set (scoped)");
+  }
+
+  struct hypercore_crypto_allocator_stats_s stats[3];
+  hypercore_crypto_buffer_t stats_hash = { 0 };
+
+  stats[0] = hypercore_crypto_allocator_stats();
+  hypercore_crypto_data(&stats_hash, &message);
+  stats[1] = hypercore_crypto_allocator_stats();
+  hypercore_crypto_free(stats_hash.bytes);
+  stats[2] = hypercore_crypto_allocator_stats();
+
+  if (
+    stats[0].alloc + 1 == stats[1].alloc &&
+    stats[1].free + 1 == stats[2].free &&
+    stats[0].current + 32 == stats[1].current &&
+    stats[0].current == stats[2].current &&
+    stats[2].peak >= stats[1].current
+  ) {
+    ok("hypercore_crypto_allocator_stats");
+  }
+
+  hypercore_crypto_metrics_t metrics;
+  rc = hypercore_crypto_metrics_snapshot(&metrics);
+
+#ifdef HYPERCORE_CRYPTO_METRICS
+  int metrics_collected =
+    0 == rc &&
+    metrics.ops[HYPERCORE_CRYPTO_METRICS_DATA].calls > 0 &&
+    metrics.ops[HYPERCORE_CRYPTO_METRICS_VERIFY].bytes >= 5 &&
+    metrics.ops[HYPERCORE_CRYPTO_METRICS_SIGN_ROOTS].calls > 0 &&
+    metrics.ops[HYPERCORE_CRYPTO_METRICS_VERIFY_BLOCK].calls > 0 &&
+    hypercore_crypto_metrics_percentile(
+      &metrics.ops[HYPERCORE_CRYPTO_METRICS_SIGN], 0.99) > 0;
+#else
+  int metrics_collected = -ENOTSUP == rc;
+#endif
+
+  if (metrics_collected) {
+    ok("hypercore_crypto_metrics_snapshot");
+  }
+
+  // every value lands in the bucket whose range covers it
+  int buckets_cover = 1;
+
+  for (unsigned long long value = 0; buckets_cover && value < 4096; ++value) {
+    unsigned long int index = hypercore_crypto_metrics_bucket_index(value);
+
+    buckets_cover =
+      value <= hypercore_crypto_metrics_bucket(index) &&
+      (0 == index || value > hypercore_crypto_metrics_bucket(index - 1));
+  }
+
+  if (
+    buckets_cover &&
+    7 == hypercore_crypto_metrics_bucket_index(7) &&
+    8 == hypercore_crypto_metrics_bucket_index(8) &&
+    15 == hypercore_crypto_metrics_bucket_index(15) &&
+    16 == hypercore_crypto_metrics_bucket_index(17) &&
+    7 == hypercore_crypto_metrics_bucket(7) &&
+    8 == hypercore_crypto_metrics_bucket(8) &&
+    15 == hypercore_crypto_metrics_bucket(15) &&
+    17 == hypercore_crypto_metrics_bucket(16) &&
+    HYPERCORE_CRYPTO_METRICS_BUCKETS - 1 ==
+      hypercore_crypto_metrics_bucket_index((unsigned long long) -1)
+  ) {
+    ok("hypercore_crypto_metrics_bucket");
+  }
+
+  hypercore_crypto_arena_t arena = { 0 };
+  unsigned char arena_memory[1024];
+  hypercore_crypto_buffer_t arena_hashes[2] = { { 0 }, { 0 } };
+  unsigned long int arena_mark = 0;
+
+  hypercore_crypto_arena_init(&arena, arena_memory, sizeof(arena_memory));
+  arena_mark = hypercore_crypto_arena_mark(&arena);
+  hypercore_crypto_arena_install(&arena);
+  hypercore_crypto_data(&arena_hashes[0], &message);
+  hypercore_crypto_free(arena_hashes[0].bytes);
+  hypercore_crypto_data(&arena_hashes[1], &message);
+  hypercore_crypto_arena_uninstall(&arena);
+
+  if (
+    arena_hashes[0].bytes == arena_hashes[1].bytes &&
+    arena_hashes[1].bytes > arena_memory &&
+    arena_hashes[1].bytes < arena_memory + sizeof(arena_memory)
+  ) {
+    hypercore_crypto_arena_reset(&arena, arena_mark);
+
+    if (arena_mark == hypercore_crypto_arena_mark(&arena)) {
+      ok("hypercore_crypto_arena_alloc");
+    }
+  }
+
+  // digests and signatures land in their own size classes once the
+  // allocation header is added
+  hypercore_crypto_buffer_t arena_hash = { 0 };
+  hypercore_crypto_buffer_t arena_signature = { 0 };
+
+  hypercore_crypto_arena_destroy(&arena);
+  hypercore_crypto_arena_init(&arena, arena_memory, sizeof(arena_memory));
+  hypercore_crypto_arena_install(&arena);
+  hypercore_crypto_data(&arena_hash, &message);
+  hypercore_crypto_sign(&arena_signature, &message, &keypair.secret_key);
+  hypercore_crypto_free(arena_hash.bytes);
+  hypercore_crypto_free(arena_signature.bytes);
+  hypercore_crypto_arena_uninstall(&arena);
+
+  if (
+    (unsigned char *) arena.recycle[0] + HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES == arena_hash.bytes &&
+    (unsigned char *) arena.recycle[1] + HYPERCORE_CRYPTO_ALLOCATOR_HEADER_BYTES == arena_signature.bytes
+  ) {
+    ok("hypercore_crypto_arena_install (size classes)");
+  }
+
+  hypercore_crypto_arena_destroy(&arena);
+
+  for (int i = 0; i < 6; ++i) {
+    hypercore_crypto_keypair_destroy(&pooled_keypairs[i]);
+  }
   hypercore_crypto_free(discoverykey.bytes);
   hypercore_crypto_keypair_destroy(&keypair);
 